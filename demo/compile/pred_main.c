@@ -0,0 +1,41 @@
+/*
+ * read LIBSVM format from stdin and print the output of predict in the generated source,
+ * one value per line as task=pred, features absent from a row are passed as NaN
+ * usage: pred_main num_feature num_output < data
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void predict(const float *feat, float *out);
+
+int main(int argc, char *argv[]) {
+  char line[65536];
+  int nfeat, nout, i;
+  float *feat, *out;
+  if (argc < 3) {
+    fprintf(stderr, "Usage: pred_main num_feature num_output < data\n");
+    return 1;
+  }
+  nfeat = atoi(argv[1]);
+  nout = atoi(argv[2]);
+  feat = (float*)malloc(sizeof(float) * nfeat);
+  out = (float*)malloc(sizeof(float) * nout);
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    char *p = line;
+    unsigned findex;
+    float fvalue;
+    int n;
+    for (i = 0; i < nfeat; ++i) feat[i] = NAN;
+    /* skip the label */
+    strtod(p, &p);
+    while (sscanf(p, " %u:%f%n", &findex, &fvalue, &n) == 2) {
+      if (findex < (unsigned)nfeat) feat[findex] = fvalue;
+      p += n;
+    }
+    predict(feat, out);
+    for (i = 0; i < nout; ++i) printf("%g\n", out[i]);
+  }
+  free(feat); free(out);
+  return 0;
+}
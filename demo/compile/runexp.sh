@@ -0,0 +1,47 @@
+#!/bin/bash
+# compile models with task=compile, and check the compiled models against task=pred
+set -e
+# map feature and split train and test as in binary classification demo
+cd ../binary_classification
+python mapfeat.py
+python mknfold.py agaricus.txt 1
+cd ../compile
+# add a quantitative feature 127 that is only missing in edible mushrooms,
+# so that splits on it send missing value to the left, as low values
+for f in agaricus.txt.train agaricus.txt.test; do
+    awk 'BEGIN { srand(1) }
+         { if ($1 == 1 || rand() < 0.5) $0 = $0 " 127:" $1 * 2 + rand(); print }' \
+        ../binary_classification/$f > $f
+done
+# 3 classes for the multi class models, poisonous mushrooms with feature 53 form class 2
+for f in agaricus.txt.train agaricus.txt.test; do
+    awk '{ if ($1 == 1 && $0 ~ / 53:1( |$)/) $1 = 2; print }' $f > multi.${f#agaricus.}
+done
+# number of features, larger than any feature index in the data
+NFEAT=128
+
+# check name nout train test [param=value]...
+# train model name, predict test with task=pred and with the compiled model, nout values per row
+check() {
+    name=$1; nout=$2; train=$3; test=$4
+    shift 4
+    ../../xgboost compile.conf data=$train model_out=$name.model "$@" silent=1 > /dev/null 2>&1
+    ../../xgboost compile.conf task=pred model_in=$name.model test:data=$test \
+        name_pred=$name.pred "$@" silent=1
+    ../../xgboost compile.conf task=compile model_in=$name.model name_code=$name.c "$@"
+    cc -O2 pred_main.c $name.c -o $name -lm
+    ./$name $NFEAT $nout < $test > $name.cpred
+    # values are printed with %g, so allow the rounding of 6 significant digits
+    paste $name.pred $name.cpred | awk -v name=$name '
+        { d = $1 - $2; if (d < 0) d = -d; m = $1 < 0 ? -$1 : $1;
+          if (d > 1e-5 * (m > 1 ? m : 1)) bad += 1 }
+        END { if (bad != 0 || NR == 0) { print name ": " bad " of " NR " values differ"; exit 1 }
+              print name ": " NR " values match task=pred" }'
+}
+
+check binary 1 agaricus.txt.train agaricus.txt.test objective=binary:logistic base_score=0.3
+check binary_margin 1 agaricus.txt.train agaricus.txt.test objective=binary:logistic \
+    base_score=0.3 pred_margin=1
+check softprob 3 multi.txt.train multi.txt.test objective=multi:softprob num_class=3
+check softmax 1 multi.txt.train multi.txt.test objective=multi:softmax num_class=3
+check linear 1 agaricus.txt.train agaricus.txt.test objective=reg:linear base_score=0.7
@@ -72,6 +72,10 @@ struct SparseBatch {
     inline static bool CmpValue(const Entry &a, const Entry &b) {
       return a.fvalue < b.fvalue;
     }
+    /*! \brief compare feature index */
+    inline static bool CmpIndex(const Entry &a, const Entry &b) {
+      return a.findex < b.findex;
+    }
   };
   /*! \brief an instance of sparse vector in the batch */
   struct Inst {
@@ -120,6 +124,11 @@ class FMatrixInterface {
     inline bst_uint rindex(void) const;
     /*! \return feature value in current position */
     inline bst_float fvalue(void) const;
+    /*!
+     * \return whether current position starts a new run of equal feature values,
+     *   always true if the column is not stored in runs
+     */
+    inline bool run_begin(void) const;
   };
   /*! \brief backward iterator over column */
   struct ColBackIter : public ColIter {};
@@ -169,34 +178,75 @@ class FMatrixInterface {
 class FMatrixS : public FMatrixInterface<FMatrixS>{
  public:
   typedef SparseBatch::Entry Entry;
-  /*! \brief row iterator */
+  /*!
+   * \brief column iterator, a column is either stored as entries,
+   *  or as runs of row indices that share the same feature value
+   */
   struct ColIter{
+    // current and end position in entry storage
     const Entry *dptr_, *end_;
+    // current and end position in run storage, NULL if column is stored as entries
+    const bst_uint *rptr_, *rend_;
+    // start of row index in run storage
+    const bst_uint *rbase_;
+    // start position of each run, and feature value of each run
+    const size_t *run_ptr_;
+    const bst_float *run_value_;
+    // current run index
+    size_t run_;
+    // whether current position starts a new run
+    bool run_begin_;
     ColIter(const Entry* begin, const Entry* end)
-        :dptr_(begin), end_(end) {}
+        :dptr_(begin), end_(end), rptr_(NULL), rend_(NULL), run_begin_(true) {}
+    ColIter(const bst_uint *rptr, const bst_uint *rend, const bst_uint *rbase,
+            const size_t *run_ptr, const bst_float *run_value, size_t run)
+        :dptr_(NULL), end_(NULL), rptr_(rptr), rend_(rend), rbase_(rbase),
+         run_ptr_(run_ptr), run_value_(run_value), run_(run), run_begin_(true) {}
     inline bool Next(void) {
-      if (dptr_ == end_) {
-        return false;
+      if (rptr_ == NULL) {
+        if (dptr_ == end_) {
+          return false;
+        } else {
+          ++dptr_; return true;
+        }
       } else {
-        ++dptr_; return true;
+        if (rptr_ == rend_) return false;
+        ++rptr_;
+        run_begin_ = static_cast<size_t>(rptr_ - rbase_) == run_ptr_[run_ + 1];
+        if (run_begin_) ++run_;
+        return true;
       }
     }
     inline bst_uint rindex(void) const {
-      return dptr_->findex;
+      return rptr_ == NULL ? dptr_->findex : *rptr_;
     }
     inline bst_float fvalue(void) const {
-      return dptr_->fvalue;
+      return rptr_ == NULL ? dptr_->fvalue : run_value_[run_];
+    }
+    inline bool run_begin(void) const {
+      return run_begin_;
     }
   };
   /*! \brief reverse column iterator */
   struct ColBackIter : public ColIter {
     ColBackIter(const Entry* dptr, const Entry* end) : ColIter(dptr, end) {}
+    ColBackIter(const bst_uint *rptr, const bst_uint *rend, const bst_uint *rbase,
+                const size_t *run_ptr, const bst_float *run_value, size_t run)
+        : ColIter(rptr, rend, rbase, run_ptr, run_value, run) {}
     // shadows ColIter::Next
     inline bool Next(void) {
-      if (dptr_ == end_) {
-        return false;
+      if (rptr_ == NULL) {
+        if (dptr_ == end_) {
+          return false;
+        } else {
+          --dptr_; return true;
+        }
       } else {
-        --dptr_; return true;
+        if (rptr_ == rend_) return false;
+        --rptr_;
+        run_begin_ = static_cast<size_t>(rptr_ - rbase_) < run_ptr_[run_];
+        if (run_begin_) --run_;
+        return true;
       }
     }
   };
@@ -224,6 +274,12 @@ class FMatrixS : public FMatrixInterface<FMatrixS>{
   /*! \brief get col sorted iterator */
   inline ColIter GetSortedCol(size_t cidx) const {
     utils::Assert(cidx < this->NumCol(), "col id exceed bound");
+    if (this->IsRunCol(cidx)) {
+      const size_t rbegin = run_ptr_[col_run_[cidx]];
+      const size_t rend = run_ptr_[col_run_[cidx + 1]];
+      return ColIter(&run_rindex_[0] + rbegin - 1, &run_rindex_[0] + rend - 1,
+                     &run_rindex_[0], &run_ptr_[0], &run_value_[0], col_run_[cidx] - 1);
+    }
     return ColIter(&col_data_[0] + col_ptr_[cidx] - 1,
                    &col_data_[0] + col_ptr_[cidx + 1] - 1);
   }
@@ -233,21 +289,43 @@ class FMatrixS : public FMatrixInterface<FMatrixS>{
    */
   inline ColBackIter GetReverseSortedCol(size_t cidx) const {
     utils::Assert(cidx < this->NumCol(), "col id exceed bound");
+    if (this->IsRunCol(cidx)) {
+      const size_t rbegin = run_ptr_[col_run_[cidx]];
+      const size_t rend = run_ptr_[col_run_[cidx + 1]];
+      return ColBackIter(&run_rindex_[0] + rend, &run_rindex_[0] + rbegin,
+                         &run_rindex_[0], &run_ptr_[0], &run_value_[0], col_run_[cidx + 1]);
+    }
     return ColBackIter(&col_data_[0] + col_ptr_[cidx + 1],
                        &col_data_[0] + col_ptr_[cidx]);
   }
   /*! \brief get col size */
   inline size_t GetColSize(size_t cidx) const {
+    if (this->IsRunCol(cidx)) {
+      return run_ptr_[col_run_[cidx + 1]] - run_ptr_[col_run_[cidx]];
+    }
     return col_ptr_[cidx+1] - col_ptr_[cidx];
   }
   /*! \brief get column density */
   inline float GetColDensity(size_t cidx) const {
-    size_t nmiss = buffered_rowset_.size() - (col_ptr_[cidx+1] - col_ptr_[cidx]);
+    size_t nmiss = buffered_rowset_.size() - this->GetColSize(cidx);
     return 1.0f - (static_cast<float>(nmiss)) / buffered_rowset_.size();
   }
-  inline void InitColAccess(float pkeep = 1.0f) {
-    if (this->HaveColAccess()) return;
-    this->InitColData(pkeep);
+  /*! \brief whether column is stored as runs of equal feature values */
+  inline bool IsRunCol(size_t cidx) const {
+    return col_run_.size() != 0 && col_run_[cidx] != col_run_[cidx + 1];
+  }
+  /*!
+   * \brief initialize column access
+   * \param pkeep probability to keep a row
+   * \param run whether store low cardinality columns as runs of equal feature values
+   */
+  inline void InitColAccess(float pkeep = 1.0f, bool run = false) {
+    if (!this->HaveColAccess()) {
+      this->InitColData(pkeep);
+    }
+    if (run && col_run_.size() == 0) {
+      this->InitColRun();
+    }
   }
   /*!
    * \brief get the row iterator associated with FMatrix
@@ -266,6 +344,11 @@ class FMatrixS : public FMatrixInterface<FMatrixS>{
    * \param fo output stream to save to
    */
   inline void SaveColAccess(utils::IStream &fo) const {
+    // columns stored in runs are not saved, column access will be rebuilt after loading
+    if (col_run_.size() != 0) {
+      fo.Write(std::vector<bst_uint>());
+      return;
+    }
     fo.Write(buffered_rowset_);
     if (buffered_rowset_.size() != 0) {
       SaveBinary(fo, col_ptr_, col_data_);
@@ -370,6 +453,43 @@ class FMatrixS : public FMatrixInterface<FMatrixS>{
                 &col_data_[col_ptr_[i + 1]], Entry::CmpValue);
     }
   }
+  /*!
+   * \brief store the columns that have long runs of equal feature values as runs,
+   *  so the feature value is stored once per run instead of once per entry
+   */
+  inline void InitColRun(void) {
+    // minimum average run length to store a column in runs
+    const size_t kMinRunLength = 4;
+    const size_t ncol = this->NumCol();
+    std::vector<size_t> new_ptr(1, 0);
+    std::vector<Entry> new_data;
+    col_run_.resize(1); col_run_[0] = 0;
+    run_ptr_.resize(1); run_ptr_[0] = 0;
+    run_value_.clear(); run_rindex_.clear();
+    for (size_t i = 0; i < ncol; ++i) {
+      size_t nrun = 0;
+      for (size_t j = col_ptr_[i]; j < col_ptr_[i + 1]; ++j) {
+        if (j == col_ptr_[i] || col_data_[j].fvalue != col_data_[j - 1].fvalue) ++nrun;
+      }
+      if (nrun * kMinRunLength <= col_ptr_[i + 1] - col_ptr_[i]) {
+        for (size_t j = col_ptr_[i]; j < col_ptr_[i + 1]; ++j) {
+          if (j == col_ptr_[i] || col_data_[j].fvalue != col_data_[j - 1].fvalue) {
+            if (j != col_ptr_[i]) run_ptr_.push_back(run_rindex_.size());
+            run_value_.push_back(col_data_[j].fvalue);
+          }
+          run_rindex_.push_back(col_data_[j].findex);
+        }
+        if (col_ptr_[i] != col_ptr_[i + 1]) run_ptr_.push_back(run_rindex_.size());
+      } else {
+        new_data.insert(new_data.end(), col_data_.begin() + col_ptr_[i],
+                        col_data_.begin() + col_ptr_[i + 1]);
+      }
+      new_ptr.push_back(new_data.size());
+      col_run_.push_back(run_value_.size());
+    }
+    col_ptr_.swap(new_ptr);
+    col_data_.swap(new_data);
+  }
 
  private:
   // --- data structure used to support InitColAccess --
@@ -380,6 +500,14 @@ class FMatrixS : public FMatrixInterface<FMatrixS>{
   std::vector<size_t> col_ptr_;
   /*! \brief column datas in CSC format */
   std::vector<SparseBatch::Entry> col_data_;
+  /*! \brief pointer to the first run of each column, empty if no column is stored in runs */
+  std::vector<size_t> col_run_;
+  /*! \brief start position of each run in run_rindex_, with an extra end position */
+  std::vector<size_t> run_ptr_;
+  /*! \brief feature value of each run */
+  std::vector<bst_float> run_value_;
+  /*! \brief row index of the entries stored in runs */
+  std::vector<bst_uint> run_rindex_;
 };
 }  // namespace xgboost
 #endif  // XGBOOST_DATA_H
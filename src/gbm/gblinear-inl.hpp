@@ -98,10 +98,16 @@ class GBLinear : public IGradBooster<FMatrix> {
     }
   }
 
+  // linear model is updated in place, so the buffer is never used
   virtual void Predict(const FMatrix &fmat,
-                       int64_t buffer_offset,
                        const BoosterInfo &info,
-                       std::vector<float> *out_preds) {
+                       PredBuffer *buffer,
+                       std::vector<float> *out_preds) const {
+    this->Predict(fmat, info, out_preds);
+  }
+  virtual void Predict(const FMatrix &fmat,
+                       const BoosterInfo &info,
+                       std::vector<float> *out_preds) const {
     std::vector<float> &preds = *out_preds;
     preds.resize(0);
     // start collecting the prediction
@@ -127,10 +133,111 @@ class GBLinear : public IGradBooster<FMatrix> {
       }
     }
   }
+  virtual void PredictStaged(const FMatrix &fmat,
+                             const BoosterInfo &info,
+                             const std::vector<unsigned> &stages,
+                             std::vector<float> *out_preds) const {
+    utils::Error("gblinear does not support staged prediction");
+  }
+  // features are summed in index order, instead of order in the row as in Predict
+  virtual void PredictDense(const tree::RegTree::FVec::Entry *dense, unsigned nrow,
+                            unsigned stride, const unsigned *root_index,
+                            float *out_preds) const {
+    const int ngroup = model.param.num_output_group;
+    const unsigned nfeat = std::min(stride, static_cast<unsigned>(model.param.num_feature));
+    for (unsigned k = 0; k < nrow; ++k) {
+      const tree::RegTree::FVec::Entry *row = dense + static_cast<size_t>(k) * stride;
+      for (int gid = 0; gid < ngroup; ++gid) {
+        float psum = model.bias()[gid];
+        for (unsigned fid = 0; fid < nfeat; ++fid) {
+          if (row[fid].flag != -1) psum += row[fid].fvalue * model[fid][gid];
+        }
+        out_preds[k * ngroup + gid] = psum;
+      }
+    }
+  }
+  virtual int NumOutputGroup(void) const {
+    return model.param.num_output_group;
+  }
+  virtual void PredictContrib(const FMatrix &fmat,
+                              const BoosterInfo &info,
+                              std::vector<float> *out_contrib) const {
+    std::vector<float> &contrib = *out_contrib;
+    const int ngroup = model.param.num_output_group;
+    const size_t nfeat = static_cast<size_t>(model.param.num_feature);
+    const size_t stride = nfeat + 1;
+    contrib.resize(0);
+    utils::IIterator<SparseBatch> *iter = fmat.RowIterator();
+    iter->BeforeFirst();
+    while (iter->Next()) {
+      const SparseBatch &batch = iter->Value();
+      contrib.resize(contrib.size() + batch.size * ngroup * stride, 0.0f);
+      const unsigned nsize = static_cast<unsigned>(batch.size);
+      #pragma omp parallel for schedule(static)
+      for (unsigned i = 0; i < nsize; ++i) {
+        const SparseBatch::Inst inst = batch[i];
+        float *p = &contrib[(batch.base_rowid + i) * ngroup * stride];
+        for (int gid = 0; gid < ngroup; ++gid, p += stride) {
+          for (bst_uint j = 0; j < inst.length; ++j) {
+            if (inst[j].findex >= nfeat) continue;
+            p[inst[j].findex] += inst[j].fvalue * model[inst[j].findex][gid];
+          }
+          p[nfeat] = model.bias()[gid];
+        }
+      }
+    }
+  }
+  virtual void PredictContrib(const FMatrix &fmat,
+                              const BoosterInfo &info,
+                              std::vector<size_t> *out_ptr,
+                              std::vector<SparseBatch::Entry> *out_contrib) const {
+    std::vector<size_t> &ptr = *out_ptr;
+    std::vector<SparseBatch::Entry> &contrib = *out_contrib;
+    const int ngroup = model.param.num_output_group;
+    const bst_uint nfeat = static_cast<bst_uint>(model.param.num_feature);
+    ptr.resize(1, 0);
+    contrib.resize(0);
+    std::vector<SparseBatch::Entry> row;
+    utils::IIterator<SparseBatch> *iter = fmat.RowIterator();
+    iter->BeforeFirst();
+    while (iter->Next()) {
+      const SparseBatch &batch = iter->Value();
+      for (size_t i = 0; i < batch.size; ++i) {
+        const SparseBatch::Inst inst = batch[i];
+        row.resize(0);
+        for (bst_uint j = 0; j < inst.length; ++j) {
+          if (inst[j].findex < nfeat) row.push_back(inst[j]);
+        }
+        std::sort(row.begin(), row.end(), SparseBatch::Entry::CmpIndex);
+        for (int gid = 0; gid < ngroup; ++gid) {
+          // duplicated features of a row are merged
+          for (size_t j = 0; j < row.size(); ++j) {
+            const float value = row[j].fvalue * model[row[j].findex][gid];
+            if (j != 0 && row[j].findex == row[j - 1].findex) {
+              contrib.back().fvalue += value;
+            } else {
+              contrib.push_back(SparseBatch::Entry(row[j].findex, value));
+            }
+          }
+          contrib.push_back(SparseBatch::Entry(nfeat, model.bias()[gid]));
+          ptr.push_back(contrib.size());
+        }
+      }
+    }
+  }
+  virtual int PredictRow(const SparseBatch::Inst &inst, unsigned root_index,
+                         float *out_preds) const {
+    this->Pred(inst, out_preds);
+    return model.param.num_output_group;
+  }
   virtual std::vector<std::string> DumpModel(const utils::FeatMap& fmap, int option) {
     utils::Error("gblinear does not support dump model");
     return std::vector<std::string>();
   }
+  virtual std::string GenerateCode(const char *func_name, int *out_ngroup) {
+    utils::Error("gblinear does not support generate code");
+    return std::string();
+  }
 
  protected:
   inline void InitFeatIndex(const FMatrix &fmat) {
@@ -145,10 +252,13 @@ class GBLinear : public IGradBooster<FMatrix> {
     }
     random::Shuffle(feat_index);
   }
-  inline void Pred(const SparseBatch::Inst &inst, float *preds) {
+  // features unknown to the model have no weight
+  inline void Pred(const SparseBatch::Inst &inst, float *preds) const {
+    const bst_uint nfeat = static_cast<bst_uint>(model.param.num_feature);
     for (int gid = 0; gid < model.param.num_output_group; ++gid) {
       float psum = model.bias()[gid];
       for (bst_uint i = 0; i < inst.length; ++i) {
+        if (inst[i].findex >= nfeat) continue;
         psum += inst[i].fvalue * model[inst[i].findex][gid];
       }
       preds[gid] = psum;
@@ -244,10 +354,16 @@ class GBLinear : public IGradBooster<FMatrix> {
     inline float* bias(void) {
       return &weight[param.num_feature * param.num_output_group];
     }
+    inline const float* bias(void) const {
+      return &weight[param.num_feature * param.num_output_group];
+    }
     // get i-th weight
     inline float* operator[](size_t i) {
       return &weight[i * param.num_output_group];
     }
+    inline const float* operator[](size_t i) const {
+      return &weight[i * param.num_output_group];
+    }
   };
   // model field
   Model model;
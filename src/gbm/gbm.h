@@ -8,10 +8,27 @@
 #include <vector>
 #include "../data.h"
 #include "../utils/fmap.h"
+#include "../tree/model.h"
 
 namespace xgboost {
 /*! \brief namespace for gradient booster */
 namespace gbm {
+/*!
+ * \brief prediction buffer of one feature matrix, kept by the caller between predictions,
+ *  so that the booster only needs to add the part of model that is new to the buffer
+ */
+struct PredBuffer {
+  /*! \brief buffered prediction, in the same layout as output of Predict, empty if not used */
+  std::vector<float> value;
+  /*! \brief number of trees summed up in value */
+  size_t num_tree;
+  /*! \brief constructor */
+  PredBuffer(void) : num_tree(0) {}
+  /*! \return bytes used by the buffer */
+  inline size_t MemCostBytes(void) const {
+    return value.size() * sizeof(float);
+  }
+};
 /*! 
  * \brief interface of gradient boosting model
  * \tparam FMatrix the data type updater taking
@@ -50,19 +67,92 @@ class IGradBooster {
                        const BoosterInfo &info,
                        std::vector<bst_gpair> *in_gpair) = 0;
   /*!
-   * \brief generate predictions for given feature matrix
+   * \brief generate predictions for given feature matrix, with a prediction buffer
+   *  of the matrix that is kept by the caller, the buffer is updated by the prediction,
+   *  so the next prediction of the same matrix only visits the part of model added later
    * \param fmat feature matrix
-   * \param buffer_offset buffer index offset of these instances, if equals -1
-   *        this means we do not have buffer index allocated to the gbm
-   *  a buffer index is assigned to each instance that requires repeative prediction
-   *  the size of buffer is set by convention using IGradBooster.SetParam("num_pbuffer","size")
    * \param info extra side information that may be needed for prediction
+   * \param buffer prediction buffer of fmat, empty for a matrix that is never predicted,
+   *   it must be emptied when the matrix or the model is replaced
    * \param out_preds output vector to hold the predictions
    */
   virtual void Predict(const FMatrix &fmat,
-                       int64_t buffer_offset,
                        const BoosterInfo &info,
-                       std::vector<float> *out_preds) = 0;
+                       PredBuffer *buffer,
+                       std::vector<float> *out_preds) const = 0;
+  /*!
+   * \brief generate predictions without prediction buffer, the booster is not modified
+   *  and all temporal space is allocated by the call, so many threads can call it
+   *  concurrently, as long as each thread uses its own feature matrix,
+   *  because row iterator of feature matrix is not threadsafe
+   * \param fmat feature matrix
+   * \param info extra side information that may be needed for prediction
+   * \param out_preds output vector to hold the predictions
+   */
+  virtual void Predict(const FMatrix &fmat,
+                       const BoosterInfo &info,
+                       std::vector<float> *out_preds) const = 0;
+  /*!
+   * \brief generate staged predictions, the margins after several numbers of boosting rounds
+   *  are computed in one pass over the model, prediction buffer is not used
+   * \param fmat feature matrix
+   * \param info extra side information that may be needed for prediction
+   * \param stages numbers of boosting rounds in increasing order, 0 means all the rounds
+   * \param out_preds output vector, nrow * nstage * ngroup values, the values of a row
+   *   are stored together, ordered by stage then output group
+   */
+  virtual void PredictStaged(const FMatrix &fmat,
+                             const BoosterInfo &info,
+                             const std::vector<unsigned> &stages,
+                             std::vector<float> *out_preds) const = 0;
+  /*!
+   * \brief predict rows that are already filled in a dense block, so that the same block
+   *  can be scored by several models, prediction buffer is not used
+   * \param dense row major features of the rows, missing feature is marked by flag == -1
+   * \param nrow number of rows in dense
+   * \param stride number of entries per row, no less than number of features of the model
+   * \param root_index root index of each row
+   * \param out_preds output array, receives nrow * NumOutputGroup() values
+   */
+  virtual void PredictDense(const tree::RegTree::FVec::Entry *dense, unsigned nrow,
+                            unsigned stride, const unsigned *root_index,
+                            float *out_preds) const = 0;
+  /*! \return number of values predicted for each row */
+  virtual int NumOutputGroup(void) const = 0;
+  /*!
+   * \brief feature contributions of the prediction, the margin of each row and output group
+   *  is split into the contribution of each feature and a bias term, prediction buffer is not used
+   * \param fmat feature matrix
+   * \param info extra side information
+   * \param out_contrib output vector, each row and output group takes num_feature + 1 values,
+   *   the last of which is the bias term, the values sum to the margin from Predict
+   */
+  virtual void PredictContrib(const FMatrix &fmat,
+                              const BoosterInfo &info,
+                              std::vector<float> *out_contrib) const = 0;
+  /*!
+   * \brief sparse version of PredictContrib, only the features that contribute are output
+   * \param fmat feature matrix
+   * \param info extra side information
+   * \param out_ptr the contributions of row i and output group g are stored in
+   *   [out_ptr[i * ngroup + g], out_ptr[i * ngroup + g + 1]) of out_contrib
+   * \param out_contrib the contributions in increasing order of feature index,
+   *   the bias term is always the last one, with index num_feature
+   */
+  virtual void PredictContrib(const FMatrix &fmat,
+                              const BoosterInfo &info,
+                              std::vector<size_t> *out_ptr,
+                              std::vector<SparseBatch::Entry> *out_contrib) const = 0;
+  /*!
+   * \brief predict a single instance, prediction buffer is not used
+   *  and no parallel region is started, so it is cheap for one row
+   * \param inst the instance to be predicted
+   * \param root_index root index of the instance
+   * \param out_preds output array, receives one value per output group
+   * \return number of values written to out_preds
+   */
+  virtual int PredictRow(const SparseBatch::Inst &inst, unsigned root_index,
+                         float *out_preds) const = 0;
   /*!
    * \brief dump the model in text format
    * \param fmap feature map that may help give interpretations of feature
@@ -70,6 +160,16 @@ class IGradBooster {
    * \return a vector of dump for boosters
    */
   virtual std::vector<std::string> DumpModel(const utils::FeatMap& fmap, int option) = 0;
+  /*!
+   * \brief generate standalone C code of margin prediction,
+   *  the code defines static void func_name(const float *f, float *margin),
+   *  where f is dense feature vector with NaN as missing value,
+   *  and margin receives one value per output group
+   * \param func_name name of the function to be defined
+   * \param out_ngroup number of output group of the model
+   * \return the generated code
+   */
+  virtual std::string GenerateCode(const char *func_name, int *out_ngroup) = 0;
   // destrcutor
   virtual ~IGradBooster(void){}
 };
@@ -8,8 +8,13 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <sstream>
+#include <algorithm>
 #include "./gbm.h"
 #include "../tree/updater.h"
+#include "../tree/flat_ensemble.h"
+#include "../tree/quick_scorer.h"
+#include "../tree/oblivious_ensemble.h"
 
 namespace xgboost {
 namespace gbm {
@@ -20,6 +25,7 @@ namespace gbm {
 template<typename FMatrix>
 class GBTree : public IGradBooster<FMatrix> {
  public:
+  GBTree(void) : loaded_format(0) {}
   virtual ~GBTree(void) {
     this->Clear();
   }
@@ -35,56 +41,85 @@ class GBTree : public IGradBooster<FMatrix> {
       this->SetParam("bst:silent", val);
     }
     tparam.SetParam(name, val);
-    if (trees.size() == 0) mparam.SetParam(name, val);
+    if (mparam.num_trees == 0) mparam.SetParam(name, val);
+    this->InitPredEngine();
   }
   virtual void LoadModel(utils::IStream &fi) {
     this->Clear();
     utils::Check(fi.Read(&mparam, sizeof(ModelParam)) != 0,
                  "GBTree: invalid model file");
+    // the flag only describes the file
+    const int format = mparam.inference_format;
+    mparam.inference_format = 0;
+    loaded_format = format;
+    if (format == 2) {
+      // flat format only keeps the layout used in prediction, arrays are used in place if mapped
+      flat_trees.LoadModel(fi, mparam.num_trees, static_cast<unsigned>(mparam.num_feature),
+                           mparam.num_output_group);
+      for (int i = 0; i < mparam.num_trees; ++i) {
+        tree_info.push_back(flat_trees.TreeGroup(i));
+      }
+      this->InitPredEngine();
+      return;
+    }
+    const bool inference = format != 0;
     trees.resize(mparam.num_trees);
     for (size_t i = 0; i < trees.size(); ++i) {
       trees[i] = new tree::RegTree();
-      trees[i]->LoadModel(fi);
+      if (inference) {
+        trees[i]->LoadModelCompact(fi);
+      } else {
+        trees[i]->LoadModel(fi);
+      }
     }
     tree_info.resize(mparam.num_trees);
     if (mparam.num_trees != 0) {
       utils::Check(fi.Read(&tree_info[0], sizeof(int) * mparam.num_trees) != 0,
                    "GBTree: invalid model file");
     }
+    for (size_t i = 0; i < trees.size(); ++i) {
+      flat_trees.AddTree(*trees[i], tree_info[i]);
+    }
+    this->InitPredEngine();
     if (mparam.num_pbuffer != 0) {
-      pred_buffer.resize(mparam.PredBufferSize());
-      pred_counter.resize(mparam.PredBufferSize());
-      utils::Check(fi.Read(&pred_buffer[0], pred_buffer.size() * sizeof(float)) != 0,
-                   "GBTree: invalid model file");
-      utils::Check(fi.Read(&pred_counter[0], pred_counter.size() * sizeof(unsigned)) != 0,
-                   "GBTree: invalid model file");
+      // model files of older versions keep prediction buffer, which is now kept by the caller
+      const size_t nbuffer = static_cast<size_t>(mparam.num_pbuffer) * mparam.num_output_group;
+      std::vector<char> skip(nbuffer * (sizeof(float) + sizeof(unsigned)));
+      utils::Check(fi.Read(&skip[0], skip.size()) != 0, "GBTree: invalid model file");
+      mparam.num_pbuffer = 0;
     }
   }
   virtual void SaveModel(utils::IStream &fo) const {
-    utils::Assert(mparam.num_trees == static_cast<int>(trees.size()), "GBTree");
-    fo.Write(&mparam, sizeof(ModelParam));
+    ModelParam param = mparam;
+    if (tparam.save_mode != 0) {
+      param.inference_format = tparam.save_mode;
+    }
+    if (param.inference_format == 2) {
+      fo.Write(&param, sizeof(ModelParam));
+      flat_trees.SaveModel(fo);
+      return;
+    }
+    this->CheckTrees("save model in this save_mode");
+    fo.Write(&param, sizeof(ModelParam));
     for (size_t i = 0; i < trees.size(); ++i) {
-      trees[i]->SaveModel(fo);
+      if (param.inference_format != 0) {
+        trees[i]->SaveModelCompact(fo);
+      } else {
+        trees[i]->SaveModel(fo);
+      }
     }
     if (tree_info.size() != 0) {
       fo.Write(&tree_info[0], sizeof(int) * tree_info.size());
     }
-    if (mparam.num_pbuffer != 0) {
-      fo.Write(&pred_buffer[0], pred_buffer.size() * sizeof(float));
-      fo.Write(&pred_counter[0], pred_counter.size() * sizeof(unsigned));
-    }
   }
-  // initialize the predic buffer
   virtual void InitModel(void) {
-    pred_buffer.clear(); pred_counter.clear();
-    pred_buffer.resize(mparam.PredBufferSize(), 0.0f);
-    pred_counter.resize(mparam.PredBufferSize(), 0);
     utils::Assert(mparam.num_trees == 0, "GBTree: model already initialized");
     utils::Assert(trees.size() == 0, "GBTree: model already initialized");
   }
   virtual void DoBoost(const FMatrix &fmat,
                        const BoosterInfo &info,
                        std::vector<bst_gpair> *in_gpair) {
+    this->CheckTrees("continue training");
     const std::vector<bst_gpair> &gpair = *in_gpair;
     if (mparam.num_output_group == 1) {
       this->BoostNewTrees(gpair, fmat, info, 0);
@@ -103,66 +138,160 @@ class GBTree : public IGradBooster<FMatrix> {
     }
   }
   virtual void Predict(const FMatrix &fmat,
-                       int64_t buffer_offset,
                        const BoosterInfo &info,
-                       std::vector<float> *out_preds) {
-    int nthread;
-    #pragma omp parallel
-    {
-      nthread = omp_get_num_threads();
+                       PredBuffer *buffer,
+                       std::vector<float> *out_preds) const {
+    // the buffer is built by another model if it has more trees
+    const bool use_buffer = buffer->value.size() != 0 && buffer->num_tree <= flat_trees.NumTree();
+    this->PredictBatch(fmat, info, use_buffer ? &buffer->value[0] : NULL,
+                       use_buffer ? buffer->num_tree : 0,
+                       std::vector<size_t>(1, flat_trees.NumTree()), out_preds);
+    buffer->value = *out_preds;
+    buffer->num_tree = flat_trees.NumTree();
+  }
+  virtual void Predict(const FMatrix &fmat,
+                       const BoosterInfo &info,
+                       std::vector<float> *out_preds) const {
+    this->PredictBatch(fmat, info, NULL, 0,
+                       std::vector<size_t>(1, flat_trees.NumTree()), out_preds);
+  }
+  virtual void PredictStaged(const FMatrix &fmat,
+                             const BoosterInfo &info,
+                             const std::vector<unsigned> &stages,
+                             std::vector<float> *out_preds) const {
+    // trees of a round are added one after another, so each stage is a prefix of the trees,
+    // models of older versions do not keep num_parallel_tree, the configured value is used
+    const int nparallel = mparam.num_parallel_tree != 0 ?
+        mparam.num_parallel_tree : tparam.num_parallel_tree;
+    const size_t round_trees = static_cast<size_t>(mparam.num_output_group) *
+        std::max(nparallel, 1);
+    std::vector<size_t> stage_end(stages.size());
+    for (size_t i = 0; i < stages.size(); ++i) {
+      stage_end[i] = stages[i] == 0 ? flat_trees.NumTree() :
+          std::min(stages[i] * round_trees, flat_trees.NumTree());
+      utils::Check(i == 0 || stage_end[i] >= stage_end[i - 1],
+                   "PredictStaged: stages must be in increasing order");
     }
-    thread_temp.resize(nthread, tree::RegTree::FVec());
-    for (int i = 0; i < nthread; ++i) {
-      thread_temp[i].Init(mparam.num_feature);
+    utils::Check(stage_end.size() != 0, "PredictStaged: no stage is given");
+    this->PredictBatch(fmat, info, NULL, 0, stage_end, out_preds);
+  }
+  virtual int PredictRow(const SparseBatch::Inst &inst, unsigned root_index,
+                         float *out_preds) const {
+    if (this->UseSparse()) {
+      tree::RegTree::SparseFVec &feat = ThreadLocalSparseFVec();
+      feat.Fill(inst);
+      std::fill(out_preds, out_preds + mparam.num_output_group, 0.0f);
+      flat_trees.PredictAllGroups(feat, root_index, out_preds);
+      return mparam.num_output_group;
     }
-
-    std::vector<float> &preds = *out_preds;
-    preds.resize(0);
-    // start collecting the prediction
-    utils::IIterator<SparseBatch> *iter = fmat.RowIterator();
-    iter->BeforeFirst();
-    while (iter->Next()) {
-      const SparseBatch &batch = iter->Value();
-      utils::Assert(batch.base_rowid * mparam.num_output_group == preds.size(),
-                    "base_rowid is not set correctly");
-      // output convention: nrow * k, where nrow is number of rows
-      // k is number of group
-      preds.resize(preds.size() + batch.size * mparam.num_output_group);
-      // parallel over local batch
-      const unsigned nsize = static_cast<unsigned>(batch.size);
-      #pragma omp parallel for schedule(static)
-      for (unsigned i = 0; i < nsize; ++i) {
-        const int tid = omp_get_thread_num();
-        tree::RegTree::FVec &feats = thread_temp[tid];
-        const size_t ridx = batch.base_rowid + i;
-        const unsigned root_idx = info.GetRoot(i);
-        // loop over output groups
-        for (int gid = 0; gid < mparam.num_output_group; ++gid) {
-          preds[ridx * mparam.num_output_group + gid] =
-              this->Pred(batch[i],
-                         buffer_offset < 0 ? -1 : buffer_offset+ridx,
-                         gid, root_idx, &feats);
+    const size_t nfeat = static_cast<size_t>(mparam.num_feature);
+    tree::RegTree::FVec &feat = ThreadLocalFVec();
+    if (feat.data.size() != nfeat) feat.Init(nfeat);
+    // features unknown to the model are never used by the trees
+    for (bst_uint i = 0; i < inst.length; ++i) {
+      if (inst[i].findex < nfeat) feat.data[inst[i].findex].fvalue = inst[i].fvalue;
+    }
+    std::fill(out_preds, out_preds + mparam.num_output_group, 0.0f);
+    flat_trees.PredictAllGroups(feat, root_index, out_preds);
+    for (bst_uint i = 0; i < inst.length; ++i) {
+      if (inst[i].findex < nfeat) feat.data[inst[i].findex].flag = -1;
+    }
+    return mparam.num_output_group;
+  }
+  virtual void PredictDense(const tree::RegTree::FVec::Entry *dense, unsigned nrow,
+                            unsigned stride, const unsigned *root_index,
+                            float *out_preds) const {
+    utils::Check(stride >= static_cast<unsigned>(mparam.num_feature),
+                 "PredictDense: stride is smaller than number of features");
+    const unsigned kWidth = tree::FlatEnsemble::kBatchWidth;
+    const int ngroup = mparam.num_output_group;
+    std::fill(out_preds, out_preds + static_cast<size_t>(nrow) * ngroup, 0.0f);
+    const bool simd = tparam.pred_simd != 0 && flat_trees.SupportSimd(nrow, stride);
+    const unsigned nsimd = simd ? nrow / kWidth * kWidth : 0;
+    const size_t ntree = flat_trees.NumTree();
+    const size_t tree_block = this->TreeBlockSize();
+    // each output is summed in the order of trees, so the result equals to Predict
+    for (size_t t = 0; t < ntree; t += tree_block) {
+      const size_t tend = std::min(ntree, t + tree_block);
+      for (unsigned k = 0; k < nsimd; k += kWidth) {
+        float leaf[tree::FlatEnsemble::kBatchWidth];
+        for (size_t i = t; i < tend; ++i) {
+          flat_trees.PredictTreeBatch(i, dense + static_cast<size_t>(k) * stride, stride,
+                                      root_index + k, leaf, true);
+          float *p = out_preds + static_cast<size_t>(k) * ngroup + flat_trees.TreeGroup(i);
+          for (unsigned j = 0; j < kWidth; ++j) {
+            p[j * ngroup] += leaf[j];
+          }
+        }
+      }
+      for (unsigned k = nsimd; k < nrow; ++k) {
+        const DenseRow row(dense + static_cast<size_t>(k) * stride);
+        float *p = out_preds + static_cast<size_t>(k) * ngroup;
+        for (size_t i = t; i < tend; ++i) {
+          p[flat_trees.TreeGroup(i)] += flat_trees.PredictTree(i, row, root_index[k]);
         }
       }
     }
   }
+  virtual int NumOutputGroup(void) const {
+    return mparam.num_output_group;
+  }
+  virtual void PredictContrib(const FMatrix &fmat,
+                              const BoosterInfo &info,
+                              std::vector<float> *out_contrib) const {
+    this->ContribBatch(fmat, info, out_contrib, NULL, NULL);
+  }
+  virtual void PredictContrib(const FMatrix &fmat,
+                              const BoosterInfo &info,
+                              std::vector<size_t> *out_ptr,
+                              std::vector<SparseBatch::Entry> *out_contrib) const {
+    this->ContribBatch(fmat, info, NULL, out_ptr, out_contrib);
+  }
   virtual std::vector<std::string> DumpModel(const utils::FeatMap& fmap, int option) {
+    this->CheckTrees("dump model");
     std::vector<std::string> dump;
     for (size_t i = 0; i < trees.size(); i++) {
       dump.push_back(trees[i]->DumpModel(fmap, option&1));
     }
     return dump;
   }
+  virtual std::string GenerateCode(const char *func_name, int *out_ngroup) {
+    this->CheckTrees("generate code");
+    std::stringstream fo("");
+    for (size_t i = 0; i < trees.size(); ++i) {
+      fo << "static float " << func_name << "_tree" << i << "(const float *f) {\n"
+         << trees[i]->GenerateCode(2) << "}\n";
+    }
+    fo << "static void " << func_name << "(const float *f, float *margin) {\n";
+    for (int gid = 0; gid < mparam.num_output_group; ++gid) {
+      fo << "  margin[" << gid << "] = 0.0f;\n";
+    }
+    // same summation order as Predict
+    for (size_t i = 0; i < trees.size(); ++i) {
+      fo << "  margin[" << tree_info[i] << "] += " << func_name << "_tree" << i << "(f);\n";
+    }
+    fo << "}\n";
+    *out_ngroup = mparam.num_output_group;
+    return fo.str();
+  }
 
  protected:
+  // check the trees are available, model loaded from flat format only supports prediction
+  inline void CheckTrees(const char *action) const {
+    utils::Check(mparam.num_trees == static_cast<int>(trees.size()),
+                 "GBTree: cannot %s, model is loaded from save_mode=flat file", action);
+  }
   // clear the model
   inline void Clear(void) {
     for (size_t i = 0; i < trees.size(); ++i) {
       delete trees[i];
     }
     trees.clear();
-    pred_buffer.clear();
-    pred_counter.clear();
+    tree_info.clear();
+    flat_trees.Clear();
+    quick_trees.Clear();
+    obliv_trees.Clear();
+    loaded_format = 0;
   }
   // initialize updater before using them
   inline void InitUpdater(void) {
@@ -174,7 +303,11 @@ class GBTree : public IGradBooster<FMatrix> {
     std::string tval = tparam.updater_seq;
     char *saveptr, *pstr;
     pstr = strtok_r(&tval[0], ",", &saveptr);
+    bool oblivious = false;
     while (pstr != NULL) {
+      utils::Check(!oblivious || strcmp(pstr, "prune") != 0,
+                   "GBTree: prune breaks the shared splits of grow_oblivious, remove it");
+      if (!strcmp(pstr, "grow_oblivious")) oblivious = true;
       updaters.push_back(tree::CreateUpdater<FMatrix>(pstr));
       for (size_t j = 0; j < cfg.size(); ++j) {
         // set parameters
@@ -190,6 +323,12 @@ class GBTree : public IGradBooster<FMatrix> {
                             const BoosterInfo &info,
                             int bst_group) {
     this->InitUpdater();
+    // rounds are located by number of trees per round in staged prediction
+    if (mparam.num_trees == 0) mparam.num_parallel_tree = tparam.num_parallel_tree;
+    utils::Check(mparam.num_parallel_tree == 0 ||
+                 mparam.num_parallel_tree == tparam.num_parallel_tree,
+                 "GBTree: num_parallel_tree=%d differs from %d of the model",
+                 tparam.num_parallel_tree, mparam.num_parallel_tree);
     // create the trees
     std::vector<tree::RegTree *> new_trees;
     for (int i = 0; i < tparam.num_parallel_tree; ++i) {
@@ -207,38 +346,494 @@ class GBTree : public IGradBooster<FMatrix> {
     for (size_t i = 0; i < new_trees.size(); ++i) {
       trees.push_back(new_trees[i]);
       tree_info.push_back(bst_group);
+      flat_trees.AddTree(*new_trees[i], bst_group);
     }
     mparam.num_trees += tparam.num_parallel_tree;
+    this->InitPredEngine();
+  }
+  /*!
+   * \brief make prediction of all rows in fmat, all the temporal space is allocated locally
+   * \param buf_value buffered sums of the first buf_ntree trees, one value per row and
+   *   output group, NULL if not buffered
+   * \param buf_ntree number of trees already summed up in buf_value
+   */
+  inline void PredictBatch(const FMatrix &fmat,
+                           const BoosterInfo &info,
+                           const float *buf_value, size_t buf_ntree,
+                           const std::vector<size_t> &stage_end,
+                           std::vector<float> *out_preds) const {
+    int nthread;
+    #pragma omp parallel
+    {
+      nthread = omp_get_num_threads();
+    }
+    const unsigned row_block = this->RowBlockSize();
+    if (this->UseSparse()) {
+      std::vector<tree::RegTree::SparseFVec> feats(nthread * row_block);
+      this->PredictBatch(fmat, info, buf_value, buf_ntree, stage_end,
+                         row_block, false, &feats[0], out_preds);
+    } else if (this->UseOblivious()) {
+      std::vector<tree::ObliviousEnsemble::FVec> feats(nthread * row_block);
+      for (size_t i = 0; i < feats.size(); ++i) {
+        feats[i].Init(mparam.num_feature);
+      }
+      this->PredictBatch(fmat, info, buf_value, buf_ntree, stage_end,
+                         row_block, true, &feats[0], out_preds);
+    } else {
+      std::vector<tree::RegTree::FVec> feats(nthread * row_block);
+      for (size_t i = 0; i < feats.size(); ++i) {
+        feats[i].Init(mparam.num_feature);
+      }
+      this->PredictBatch(fmat, info, buf_value, buf_ntree, stage_end,
+                         row_block, true, &feats[0], out_preds);
+    }
+  }
+  /*!
+   * \brief make prediction of all rows in fmat with given feature vectors
+   * \param stage_end the margin of each row after first stage_end[s] trees is the s-th output,
+   *   the outputs of a row are stored together, one value per stage and output group
+   * \param row_block number of rows predicted together
+   * \param dense_engine whether the vectorized and bitvector engines can be used,
+   *   both of them visit every feature of a row, and are only used with dense feature vectors
+   * \param feats feature vectors, row_block entries per thread
+   */
+  template<typename TFVec>
+  inline void PredictBatch(const FMatrix &fmat,
+                           const BoosterInfo &info,
+                           const float *buf_value, size_t buf_ntree,
+                           const std::vector<size_t> &stage_end,
+                           unsigned row_block, bool dense_engine, TFVec *feats,
+                           std::vector<float> *out_preds) const {
+    int nthread;
+    #pragma omp parallel
+    {
+      nthread = omp_get_num_threads();
+    }
+    const size_t tree_block = this->TreeBlockSize();
+    // vectorized traversal needs the rows of a block in one dense array, which is not empty
+    const bool simd = dense_engine && tparam.pred_simd != 0 && mparam.num_feature != 0 &&
+        row_block >= tree::FlatEnsemble::kBatchWidth &&
+        flat_trees.SupportSimd(row_block, mparam.num_feature);
+    std::vector<tree::RegTree::FVec::Entry> dense;
+    if (simd) {
+      dense.resize(static_cast<size_t>(nthread) * row_block * mparam.num_feature);
+    }
+    // bitvector engine, fall back to tree traversal when some tree is not supported
+    const bool quick = dense_engine && tparam.pred_quick != 0 && trees.size() != 0 &&
+        quick_trees.NumTree() == trees.size() && quick_trees.Valid() &&
+        stage_end.size() == 1 && stage_end[0] == trees.size();
+    std::vector<uint64_t> leaves;
+    if (quick) {
+      leaves.resize(nthread * trees.size());
+    }
+    std::vector<float> pred(static_cast<size_t>(nthread) * row_block * mparam.num_output_group);
+
+    // number of outputs of each row
+    const size_t nout = stage_end.size() * mparam.num_output_group;
+    std::vector<float> &preds = *out_preds;
+    preds.resize(0);
+    // start collecting the prediction
+    utils::IIterator<SparseBatch> *iter = fmat.RowIterator();
+    iter->BeforeFirst();
+    while (iter->Next()) {
+      const SparseBatch &batch = iter->Value();
+      utils::Assert(batch.base_rowid * nout == preds.size(),
+                    "base_rowid is not set correctly");
+      // output convention: nrow * nstage * k, where nrow is number of rows
+      // k is number of group
+      preds.resize(preds.size() + batch.size * nout);
+      // parallel over blocks of local batch
+      const unsigned nsize = static_cast<unsigned>(batch.size);
+      const unsigned nblock = (nsize + row_block - 1) / row_block;
+      #pragma omp parallel for schedule(static)
+      for (unsigned j = 0; j < nblock; ++j) {
+        const int tid = omp_get_thread_num();
+        const unsigned begin = j * row_block;
+        const unsigned end = std::min(nsize, begin + row_block);
+        if (quick) {
+          this->PredBlockQuick(batch, begin, end, buf_value, buf_ntree,
+                               &feats[tid * row_block], &leaves[0] + tid * trees.size(),
+                               &preds[0]);
+          continue;
+        }
+        tree::RegTree::FVec::Entry *pdense = NULL;
+        if (simd) {
+          pdense = &dense[0] + static_cast<size_t>(tid) * row_block * mparam.num_feature;
+        }
+        this->PredBlock(batch, begin, end, buf_value, buf_ntree, info,
+                        stage_end, tree_block, &feats[tid * row_block], pdense,
+                        &pred[static_cast<size_t>(tid) * row_block * mparam.num_output_group],
+                        &preds[0]);
+      }
+    }
+  }
+  /*!
+   * \brief value of each node of tree in feature contribution, the contribution of a split
+   *  is the value of the child taken minus value of the node, as Saabas' method,
+   *  leaf takes leaf value, and internal node takes the mean of the values of its children
+   *  weighted by sum_hess, so that the contributions along a path sum to exactly the leaf value
+   */
+  inline static void ContribNodeValue(const tree::RegTree &tree, std::vector<float> *out_value) {
+    out_value->resize(tree.param.num_nodes);
+    for (int rid = 0; rid < tree.param.num_roots; ++rid) {
+      ContribMeanValue(tree, rid, out_value);
+    }
   }
-  // make a prediction for a single instance
-  inline float Pred(const SparseBatch::Inst &inst,
-                    int64_t buffer_index,
-                    int bst_group,
-                    unsigned root_index,
-                    tree::RegTree::FVec *p_feats) {
-    size_t itop = 0;
-    float  psum = 0.0f;
-    const int bid = mparam.BufferOffset(buffer_index, bst_group);
-    // load buffered results if any
-    if (bid >= 0) {
-      itop = pred_counter[bid];
-      psum = pred_buffer[bid];
-    }
-    if (itop != trees.size()) {
-      p_feats->Fill(inst);
-      for (size_t i = itop; i < trees.size(); ++i) {
-        if (tree_info[i] == bst_group) {
-          psum += trees[i]->Predict(*p_feats, root_index);
+  // fill the value of the subtree of nid, return value of nid
+  inline static float ContribMeanValue(const tree::RegTree &tree, int nid,
+                                       std::vector<float> *out_value) {
+    std::vector<float> &value = *out_value;
+    if (tree[nid].is_leaf()) {
+      return value[nid] = tree[nid].leaf_value();
+    }
+    const int cleft = tree[nid].cleft(), cright = tree[nid].cright();
+    const float vleft = ContribMeanValue(tree, cleft, out_value);
+    const float vright = ContribMeanValue(tree, cright, out_value);
+    const double hleft = tree.stat(cleft).sum_hess, hright = tree.stat(cright).sum_hess;
+    if (hleft + hright > 0.0) {
+      value[nid] = static_cast<float>((hleft * vleft + hright * vright) / (hleft + hright));
+    } else {
+      value[nid] = 0.5f * (vleft + vright);
+    }
+    return value[nid];
+  }
+  /*!
+   * \brief add feature contributions of one tree, following the path of the row
+   * \param contrib contributions of the output group of the tree, num_feature + 1 values
+   * \param mark if not NULL, the features first touched by the row are marked and added to touched
+   */
+  inline void ContribTree(size_t tid, const tree::RegTree::FVec &feat, unsigned root_id,
+                          const std::vector<float> &value, float *contrib,
+                          char *mark, std::vector<bst_uint> *touched) const {
+    const tree::RegTree &tree = *trees[tid];
+    int nid = static_cast<int>(root_id);
+    contrib[mparam.num_feature] += value[nid];
+    while (!tree[nid].is_leaf()) {
+      const unsigned split = tree[nid].split_index();
+      const int next = tree.GetNext(nid, feat.fvalue(split), feat.is_missing(split));
+      contrib[split] += value[next] - value[nid];
+      if (mark != NULL && !mark[split]) {
+        mark[split] = 1; touched->push_back(split);
+      }
+      nid = next;
+    }
+  }
+  /*!
+   * \brief feature contributions of all rows in fmat, in dense format if out_dense is not NULL,
+   *  otherwise in sparse format, rows are predicted in parallel
+   */
+  inline void ContribBatch(const FMatrix &fmat, const BoosterInfo &info,
+                           std::vector<float> *out_dense, std::vector<size_t> *out_ptr,
+                           std::vector<SparseBatch::Entry> *out_sparse) const {
+    this->CheckTrees("predict feature contribution");
+    utils::Check(loaded_format == 0,
+                 "GBTree: cannot predict feature contribution, node statistics are not kept "
+                 "in model saved with save_mode=inference");
+    const bst_uint nfeat = static_cast<bst_uint>(mparam.num_feature);
+    const size_t stride = static_cast<size_t>(nfeat) + 1;
+    const int ngroup = mparam.num_output_group;
+    std::vector< std::vector<float> > value(trees.size());
+    for (size_t i = 0; i < trees.size(); ++i) {
+      ContribNodeValue(*trees[i], &value[i]);
+    }
+    int nthread;
+    #pragma omp parallel
+    {
+      nthread = omp_get_num_threads();
+    }
+    std::vector<tree::RegTree::FVec> feats(nthread);
+    for (int i = 0; i < nthread; ++i) {
+      feats[i].Init(nfeat);
+    }
+    // sparse output: dense accumulator of the row, and the rows of each thread
+    std::vector<float> acc;
+    std::vector<char> mark;
+    std::vector< std::vector<size_t> > tptr;
+    std::vector< std::vector<SparseBatch::Entry> > tcontrib;
+    if (out_dense != NULL) {
+      out_dense->resize(0);
+    } else {
+      acc.resize(nthread * ngroup * stride, 0.0f);
+      mark.resize(nthread * stride, 0);
+      tptr.resize(nthread); tcontrib.resize(nthread);
+      out_ptr->resize(1, 0);
+      out_sparse->resize(0);
+    }
+    utils::IIterator<SparseBatch> *iter = fmat.RowIterator();
+    iter->BeforeFirst();
+    while (iter->Next()) {
+      const SparseBatch &batch = iter->Value();
+      const unsigned nsize = static_cast<unsigned>(batch.size);
+      if (out_dense != NULL) {
+        std::vector<float> &contrib = *out_dense;
+        contrib.resize(contrib.size() + batch.size * ngroup * stride, 0.0f);
+        #pragma omp parallel for schedule(static)
+        for (unsigned i = 0; i < nsize; ++i) {
+          tree::RegTree::FVec &feat = feats[omp_get_thread_num()];
+          const size_t ridx = batch.base_rowid + i;
+          this->FillFVec(batch[i], &feat);
+          float *p = &contrib[ridx * ngroup * stride];
+          for (size_t j = 0; j < trees.size(); ++j) {
+            this->ContribTree(j, feat, info.GetRoot(ridx), value[j],
+                              p + tree_info[j] * stride, NULL, NULL);
+          }
+          this->DropFVec(batch[i], &feat);
+        }
+        continue;
+      }
+      // each thread takes a contiguous range of rows, so the outputs are joined in order
+      #pragma omp parallel for schedule(static, 1)
+      for (int t = 0; t < nthread; ++t) {
+        tree::RegTree::FVec &feat = feats[t];
+        float *pacc = &acc[t * ngroup * stride];
+        char *pmark = &mark[t * stride];
+        std::vector<bst_uint> touched;
+        tptr[t].resize(0); tcontrib[t].resize(0);
+        const unsigned begin = static_cast<unsigned>(static_cast<size_t>(nsize) * t / nthread);
+        const unsigned end = static_cast<unsigned>(static_cast<size_t>(nsize) * (t + 1) / nthread);
+        for (unsigned i = begin; i < end; ++i) {
+          const size_t ridx = batch.base_rowid + i;
+          this->FillFVec(batch[i], &feat);
+          touched.resize(0);
+          for (size_t j = 0; j < trees.size(); ++j) {
+            this->ContribTree(j, feat, info.GetRoot(ridx), value[j],
+                              pacc + tree_info[j] * stride, pmark, &touched);
+          }
+          this->DropFVec(batch[i], &feat);
+          std::sort(touched.begin(), touched.end());
+          touched.push_back(nfeat);
+          for (int gid = 0; gid < ngroup; ++gid) {
+            float *p = pacc + gid * stride;
+            for (size_t k = 0; k < touched.size(); ++k) {
+              tcontrib[t].push_back(SparseBatch::Entry(touched[k], p[touched[k]]));
+              p[touched[k]] = 0.0f;
+            }
+            tptr[t].push_back(tcontrib[t].size());
+          }
+          for (size_t k = 0; k < touched.size(); ++k) {
+            pmark[touched[k]] = 0;
+          }
+        }
+      }
+      for (int t = 0; t < nthread; ++t) {
+        const size_t offset = out_sparse->size();
+        for (size_t k = 0; k < tptr[t].size(); ++k) {
+          out_ptr->push_back(offset + tptr[t][k]);
         }
+        out_sparse->insert(out_sparse->end(), tcontrib[t].begin(), tcontrib[t].end());
+      }
+    }
+  }
+  // fill dense feature vector, features unknown to the model are never used by the trees
+  inline void FillFVec(const SparseBatch::Inst &inst, tree::RegTree::FVec *feat) const {
+    for (bst_uint i = 0; i < inst.length; ++i) {
+      if (inst[i].findex < static_cast<bst_uint>(mparam.num_feature)) {
+        feat->data[inst[i].findex].fvalue = inst[i].fvalue;
+      }
+    }
+  }
+  inline void DropFVec(const SparseBatch::Inst &inst, tree::RegTree::FVec *feat) const {
+    for (bst_uint i = 0; i < inst.length; ++i) {
+      if (inst[i].findex < static_cast<bst_uint>(mparam.num_feature)) {
+        feat->data[inst[i].findex].flag = -1;
       }
-      p_feats->Drop(inst);
     }
-    // updated the buffered results
-    if (bid >= 0) {
-      pred_counter[bid] = static_cast<unsigned>(trees.size());
-      pred_buffer[bid] = psum;
+  }
+  // sparse feature vector looks features up by index, so any feature index is safe
+  inline void FillFVec(const SparseBatch::Inst &inst, tree::RegTree::SparseFVec *feat) const {
+    feat->Fill(inst);
+  }
+  inline void DropFVec(const SparseBatch::Inst &inst, tree::RegTree::SparseFVec *feat) const {}
+  // one row of a row major dense block, missing value is marked by flag == -1
+  struct DenseRow {
+    const tree::RegTree::FVec::Entry *row;
+    explicit DenseRow(const tree::RegTree::FVec::Entry *row) : row(row) {}
+    inline float fvalue(size_t i) const {
+      return row[i].fvalue;
+    }
+    inline bool is_missing(size_t i) const {
+      return row[i].flag == -1;
+    }
+  };
+  // dense feature vector of current thread, used by single row prediction
+  inline static tree::RegTree::FVec &ThreadLocalFVec(void) {
+    static thread_local tree::RegTree::FVec feat;
+    return feat;
+  }
+  // sparse feature vector of current thread, used by single row prediction
+  inline static tree::RegTree::SparseFVec &ThreadLocalSparseFVec(void) {
+    static thread_local tree::RegTree::SparseFVec feat;
+    return feat;
+  }
+  // whether the feature space is too large to keep dense feature vectors
+  inline bool UseSparse(void) const {
+    const size_t threshold = tparam.pred_sparse_feature != 0 ?
+        static_cast<size_t>(tparam.pred_sparse_feature) :
+        kCacheBytes / sizeof(tree::RegTree::FVec::Entry);
+    return static_cast<size_t>(mparam.num_feature) > threshold;
+  }
+  // update the bitvector or oblivious engine if it is used and new trees are added,
+  // both engines only take the new trees
+  inline void InitPredEngine(void) {
+    if (tparam.pred_quick != 0 && quick_trees.NumTree() != trees.size()) {
+      quick_trees.AddTrees(trees, mparam.num_feature);
+    }
+    if (tparam.pred_obliv != 0 && obliv_trees.NumTree() != flat_trees.NumTree()) {
+      obliv_trees.AddTrees(flat_trees);
+    }
+  }
+  // whether the oblivious engine is used, flat trees are used instead if some tree is not oblivious
+  inline bool UseOblivious(void) const {
+    return tparam.pred_obliv != 0 && !this->UseSparse() &&
+        obliv_trees.NumTree() == flat_trees.NumTree() && obliv_trees.Valid();
+  }
+  // value of tree tid, the engine is chosen by type of feature vector
+  template<typename TFVec>
+  inline float PredictTree(size_t tid, const TFVec &feat, unsigned root_id) const {
+    return flat_trees.PredictTree(tid, feat, root_id);
+  }
+  inline float PredictTree(size_t tid, const tree::ObliviousEnsemble::FVec &feat,
+                           unsigned root_id) const {
+    return obliv_trees.PredictTree(tid, feat, root_id);
+  }
+  // vectorized version of PredictTree, feats only selects the engine
+  template<typename TFVec>
+  inline void PredictTreeBatch(size_t tid, const TFVec *feats,
+                               const tree::RegTree::FVec::Entry *dense, unsigned stride,
+                               const unsigned *root_id, float *out_pred) const {
+    flat_trees.PredictTreeBatch(tid, dense, stride, root_id, out_pred, true);
+  }
+  inline void PredictTreeBatch(size_t tid, const tree::ObliviousEnsemble::FVec *feats,
+                               const tree::RegTree::FVec::Entry *dense, unsigned stride,
+                               const unsigned *root_id, float *out_pred) const {
+    obliv_trees.PredictTreeBatch(tid, dense, stride, out_pred, true);
+  }
+  // number of rows predicted together, limited so that the dense feature vectors stay in cache
+  inline unsigned RowBlockSize(void) const {
+    if (tparam.pred_row_block != 0) return static_cast<unsigned>(tparam.pred_row_block);
+    // size of sparse feature vectors only depends on length of rows
+    if (this->UseSparse()) return static_cast<unsigned>(kAutoRowBlock);
+    const size_t nfeat = std::max(mparam.num_feature, 1);
+    return static_cast<unsigned>(std::max(std::min(kCacheBytes / (nfeat * sizeof(float)),
+                                                   kAutoRowBlock), static_cast<size_t>(1)));
+  }
+  // number of trees visited by a block of rows before moving to the next trees
+  inline size_t TreeBlockSize(void) const {
+    if (tparam.pred_tree_block != 0) return static_cast<size_t>(tparam.pred_tree_block);
+    if (flat_trees.NumTree() == 0) return 1;
+    const size_t tree_bytes = flat_trees.NumNode() * sizeof(tree::FlatEnsemble::Node)
+        / flat_trees.NumTree();
+    return std::max(kCacheBytes / std::max(tree_bytes, static_cast<size_t>(1)),
+                    static_cast<size_t>(1));
+  }
+  /*!
+   * \brief make prediction for rows [begin, end) of batch, the trees are visited block by block,
+   *  each block of trees is applied to all the rows, while the rows are kept in feats
+   * \param dense if not NULL, the rows are also copied into this row major array,
+   *  and traversed kBatchWidth rows at a time by the vectorized kernel
+   * \param pred temporal space of the partial sums, one entry per row and output group
+   * \param stage_end the partial sums are written out each time stage_end[s] trees are visited,
+   *  the buffer is only used when there is one stage ending at the last tree
+   */
+  template<typename TFVec>
+  inline void PredBlock(const SparseBatch &batch, unsigned begin, unsigned end,
+                        const float *buf_value, size_t buf_ntree,
+                        const BoosterInfo &info, const std::vector<size_t> &stage_end,
+                        size_t tree_block, TFVec *feats,
+                        tree::RegTree::FVec::Entry *dense, float *pred,
+                        float *out_preds) const {
+    const int kWidth = tree::FlatEnsemble::kBatchWidth;
+    const int ngroup = mparam.num_output_group;
+    const unsigned nrow = end - begin;
+    const unsigned nfeat = static_cast<unsigned>(mparam.num_feature);
+    for (unsigned k = 0; k < nrow; ++k) {
+      this->FillFVec(batch[begin + k], &feats[k]);
+    }
+    const unsigned nsimd = dense == NULL ? 0 : nrow / kWidth * kWidth;
+    for (unsigned k = 0; k < nsimd; ++k) {
+      tree::RegTree::FVec::Entry *row = dense + k * nfeat, e;
+      e.flag = -1;
+      std::fill(row, row + nfeat, e);
+      const SparseBatch::Inst inst = batch[begin + k];
+      for (bst_uint i = 0; i < inst.length; ++i) {
+        if (inst[i].findex < nfeat) row[inst[i].findex].fvalue = inst[i].fvalue;
+      }
+    }
+    // load buffered results if any, trees before itop are already summed up
+    const size_t itop = buf_value == NULL ? 0 : buf_ntree;
+    unsigned root_idx[kMaxRowBlock];
+    for (unsigned k = 0; k < nrow; ++k) {
+      const size_t ridx = batch.base_rowid + begin + k;
+      for (int gid = 0; gid < ngroup; ++gid) {
+        pred[k * ngroup + gid] = buf_value == NULL ? 0.0f : buf_value[ridx * ngroup + gid];
+      }
+      root_idx[k] = info.GetRoot(ridx);
+    }
+    // all the groups are scored in one pass over the trees,
+    // trees of each group are still added in model order
+    const size_t nstage = stage_end.size();
+    size_t tbegin = 0;
+    for (size_t s = 0; s < nstage; ++s) {
+      for (size_t t = tbegin; t < stage_end[s]; t += tree_block) {
+        const size_t tend = std::min(stage_end[s], t + tree_block);
+        for (unsigned k = 0; k < nsimd; k += kWidth) {
+          float leaf[kWidth];
+          for (size_t i = std::max(t, itop); i < tend; ++i) {
+            this->PredictTreeBatch(i, feats, dense + k * nfeat, nfeat, root_idx + k, leaf);
+            float *p = pred + k * ngroup + flat_trees.TreeGroup(i);
+            for (int j = 0; j < kWidth; ++j) {
+              p[j * ngroup] += leaf[j];
+            }
+          }
+        }
+        for (unsigned k = nsimd; k < nrow; ++k) {
+          float *p = pred + k * ngroup;
+          for (size_t i = std::max(t, itop); i < tend; ++i) {
+            p[flat_trees.TreeGroup(i)] += this->PredictTree(i, feats[k], root_idx[k]);
+          }
+        }
+      }
+      tbegin = std::max(tbegin, stage_end[s]);
+      for (unsigned k = 0; k < nrow; ++k) {
+        const size_t ridx = batch.base_rowid + begin + k;
+        for (int gid = 0; gid < ngroup; ++gid) {
+          out_preds[(ridx * nstage + s) * ngroup + gid] = pred[k * ngroup + gid];
+        }
+      }
+    }
+    for (unsigned k = 0; k < nrow; ++k) {
+      this->DropFVec(batch[begin + k], &feats[k]);
+    }
+  }
+  /*!
+   * \brief make prediction for rows [begin, end) of batch with the bitvector engine,
+   *  exit leaves of all the trees are computed at once for each row
+   * \param leaves temporal space to store leaf bitvector of each tree
+   */
+  template<typename TFVec>
+  inline void PredBlockQuick(const SparseBatch &batch, unsigned begin, unsigned end,
+                             const float *buf_value, size_t buf_ntree,
+                             TFVec *feat,
+                             uint64_t *leaves, float *out_preds) const {
+    const int ngroup = mparam.num_output_group;
+    for (unsigned k = begin; k < end; ++k) {
+      const size_t ridx = batch.base_rowid + k;
+      this->FillFVec(batch[k], feat);
+      quick_trees.Predict(*feat, leaves);
+      for (int gid = 0; gid < ngroup; ++gid) {
+        // load buffered results if any
+        const size_t itop = buf_value == NULL ? 0 : buf_ntree;
+        float psum = buf_value == NULL ? 0.0f : buf_value[ridx * ngroup + gid];
+        if (static_cast<size_t>(gid) < flat_trees.NumGroup()) {
+          const std::vector<unsigned> &gtrees = flat_trees.GroupTrees(gid);
+          for (size_t i = 0; i < gtrees.size(); ++i) {
+            if (gtrees[i] >= itop) psum += quick_trees.LeafValue(gtrees[i], leaves[gtrees[i]]);
+          }
+        }
+        out_preds[ridx * ngroup + gid] = psum;
+      }
+      this->DropFVec(batch[k], feat);
     }
-    return psum;
   }
   // --- data structure ---
   /*! \brief training parameters */
@@ -254,12 +849,39 @@ class GBTree : public IGradBooster<FMatrix> {
     int updater_initialized;
     /*! \brief tree updater sequence */
     std::string updater_seq;
+    /*! \brief number of rows predicted together, 0 means decided by number of features */
+    int pred_row_block;
+    /*! \brief number of trees in a prediction block, 0 means decided by size of trees */
+    int pred_tree_block;
+    /*! \brief whether to use vectorized tree traversal when cpu supports it */
+    int pred_simd;
+    /*! \brief whether to use the bitvector engine, set by predictor=quickscorer */
+    int pred_quick;
+    /*! \brief whether to use branch free traversal of oblivious trees, predictor=oblivious */
+    int pred_obliv;
+    /*!
+     * \brief sparse feature vectors are used in prediction when number of features exceeds it,
+     *   0 means decided by cache size
+     */
+    int pred_sparse_feature;
+    /*!
+     * \brief format of saved model, 0: full model, 1: compact trees, set by save_mode=inference,
+     *   2: flattened trees that can be memory mapped, set by save_mode=flat
+     */
+    int save_mode;
     // construction
     TrainParam(void) {
       nthread = 0;
       updater_seq = "grow_colmaker,prune";
       num_parallel_tree = 1;
       updater_initialized = 0;
+      pred_row_block = 0;
+      pred_tree_block = 0;
+      pred_simd = 1;
+      pred_quick = 0;
+      pred_obliv = 0;
+      pred_sparse_feature = 0;
+      save_mode = 0;
     }
     inline void SetParam(const char *name, const char *val){
       if (!strcmp(name, "updater") &&
@@ -273,6 +895,27 @@ class GBTree : public IGradBooster<FMatrix> {
       if (!strcmp(name, "num_parallel_tree")) {
         num_parallel_tree = atoi(val);
       }
+      if (!strcmp(name, "pred_row_block")) {
+        pred_row_block = std::min(std::max(atoi(val), 0), static_cast<int>(kMaxRowBlock));
+      }
+      if (!strcmp(name, "pred_tree_block")) {
+        pred_tree_block = std::max(atoi(val), 0);
+      }
+      if (!strcmp(name, "pred_simd")) pred_simd = atoi(val);
+      if (!strcmp(name, "predictor")) {
+        pred_quick = !strcmp(val, "quickscorer");
+        pred_obliv = !strcmp(val, "oblivious");
+      }
+      if (!strcmp(name, "pred_sparse_feature")) pred_sparse_feature = std::max(atoi(val), 0);
+      if (!strcmp(name, "save_mode")) {
+        if (!strcmp(val, "inference")) {
+          save_mode = 1;
+        } else if (!strcmp(val, "flat")) {
+          save_mode = 2;
+        } else {
+          save_mode = 0;
+        }
+      }
     }
   };
   /*! \brief model parameters */
@@ -283,7 +926,10 @@ class GBTree : public IGradBooster<FMatrix> {
     int num_roots;
     /*! \brief number of features to be used by trees */
     int num_feature;
-    /*! \brief size of predicton buffer allocated used for buffering */
+    /*!
+     * \brief size of predicton buffer saved in model files of older versions,
+     *  the buffer is now kept by the caller of Predict, and is not saved
+     */
     int64_t num_pbuffer;
     /*! 
      * \brief how many output group a single instance can produce
@@ -291,14 +937,24 @@ class GBTree : public IGradBooster<FMatrix> {
      *    suppose we have n instance and k group, output will be k*n 
      */
     int num_output_group;
+    /*!
+     * \brief whether the model file is in inference format, without prediction buffer,
+     *  1: trees are saved without node statistics in compact format,
+     *  2: the flattened trees used in prediction are saved, and can be memory mapped
+     */
+    int inference_format;
+    /*! \brief number of trees of each output group per round, 0 in model files of older versions */
+    int num_parallel_tree;
     /*! \brief reserved parameters */
-    int reserved[32];
+    int reserved[30];
     /*! \brief constructor */
     ModelParam(void) {
       num_trees = 0;
       num_roots = num_feature = 0;
       num_pbuffer = 0;
       num_output_group = 1;
+      inference_format = 0;
+      num_parallel_tree = 0;
       memset(reserved, 0, sizeof(reserved));
     }
     /*!
@@ -307,25 +963,17 @@ class GBTree : public IGradBooster<FMatrix> {
      * \param val  value of the parameter
      */
     inline void SetParam(const char *name, const char *val) {
-      if (!strcmp("num_pbuffer", name)) num_pbuffer = atol(val);
       if (!strcmp("num_output_group", name)) num_output_group = atol(val);
       if (!strcmp("bst:num_roots", name)) num_roots = atoi(val);
       if (!strcmp("bst:num_feature", name)) num_feature = atoi(val);
     }
-    /*! \return size of prediction buffer actually needed */
-    inline size_t PredBufferSize(void) const {
-      return num_output_group * num_pbuffer;
-    }
-    /*! 
-     * \brief get the buffer offset given a buffer index and group id  
-     * \return calculated buffer offset
-     */
-    inline size_t BufferOffset(int64_t buffer_index, int bst_group) const {
-      if (buffer_index < 0) return -1;
-      utils::Check(buffer_index < num_pbuffer, "buffer_index exceed num_pbuffer");
-      return buffer_index + num_pbuffer * bst_group;
-    }
   };
+  /*! \brief maximum number of rows predicted together */
+  static const size_t kMaxRowBlock = 64;
+  /*! \brief default upper bound of rows predicted together */
+  static const size_t kAutoRowBlock = 32;
+  /*! \brief cache budget of the feature vectors of a row block, and of a tree block */
+  static const size_t kCacheBytes = 256 << 10;
   // training parameter
   TrainParam tparam;
   // model parameter
@@ -334,15 +982,17 @@ class GBTree : public IGradBooster<FMatrix> {
   std::vector<tree::RegTree*> trees;
   /*! \brief some information indicator of the tree, reserved */
   std::vector<int> tree_info;
-  /*! \brief prediction buffer */
-  std::vector<float>  pred_buffer;
-  /*! \brief prediction buffer counter, remember the prediction */
-  std::vector<unsigned> pred_counter;
+  /*! \brief inference layout of trees, new trees are appended before prediction */
+  tree::FlatEnsemble flat_trees;
+  /*! \brief bitvector engine of trees, new trees are added to it if predictor=quickscorer */
+  tree::QuickScorer quick_trees;
+  /*! \brief trees with one split per depth, rebuilt when trees change if predictor=oblivious */
+  tree::ObliviousEnsemble obliv_trees;
+  /*! \brief inference_format of the loaded model file, node statistics are lost if not 0 */
+  int loaded_format;
   // ----training fields----
   // configurations for tree
   std::vector< std::pair<std::string, std::string> > cfg;
-  // temporal storage for per thread
-  std::vector<tree::RegTree::FVec> thread_temp;
   // the updaters that can be applied to each of tree
   std::vector< tree::IUpdater<FMatrix>* > updaters;
 };
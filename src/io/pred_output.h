@@ -0,0 +1,83 @@
+#ifndef XGBOOST_IO_PRED_OUTPUT_H_
+#define XGBOOST_IO_PRED_OUTPUT_H_
+/*!
+ * \file pred_output.h
+ * \brief writing predictions to file, either as text with one value per line,
+ *   or as raw little endian float32 values that can be mapped into memory directly
+ */
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../utils/omp.h"
+#include "../utils/utils.h"
+
+namespace xgboost {
+namespace io {
+/*! \brief number of values formatted together by a thread in WritePred */
+const size_t kPredBlock = 64 << 10;
+/*!
+ * \brief append predictions to the output buffer
+ * \param preds the predictions
+ * \param n number of predictions
+ * \param binary whether to append raw little endian float32 values instead of text
+ * \param out the output buffer
+ */
+inline void AppendPred(const float *preds, size_t n, bool binary, std::string *out) {
+  if (binary) {
+    const size_t begin = out->length();
+    out->resize(begin + n * sizeof(float));
+    char *p = &(*out)[begin];
+    std::memcpy(p, preds, n * sizeof(float));
+    const unsigned one = 1;
+    if (*reinterpret_cast<const char*>(&one) == 0) {
+      for (size_t i = 0; i < n; ++i) {
+        std::reverse(p + i * sizeof(float), p + (i + 1) * sizeof(float));
+      }
+    }
+    return;
+  }
+  char tmp[utils::kFloatTextLen + 1];
+  out->reserve(out->length() + n * 10);
+  for (size_t i = 0; i < n; ++i) {
+    const int len = utils::FloatToText(preds[i], tmp);
+    tmp[len] = '\n';
+    out->append(tmp, len + 1);
+  }
+}
+/*!
+ * \brief write predictions to file, blocks of values are formatted in parallel
+ *  and written in order
+ * \param fname name of output file
+ * \param preds the predictions
+ * \param binary whether to write raw little endian float32 values instead of text
+ */
+inline void WritePred(const char *fname, const std::vector<float> &preds, bool binary) {
+  FILE *fo = utils::FopenCheck(fname, binary ? "wb" : "w");
+  int nthread;
+  #pragma omp parallel
+  {
+    nthread = omp_get_num_threads();
+  }
+  std::vector<std::string> out(nthread);
+  const size_t nblock = (preds.size() + kPredBlock - 1) / kPredBlock;
+  for (size_t b = 0; b < nblock; b += nthread) {
+    const int nb = static_cast<int>(std::min(nblock - b, static_cast<size_t>(nthread)));
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < nb; ++j) {
+      const size_t begin = (b + j) * kPredBlock;
+      const size_t end = std::min(preds.size(), begin + kPredBlock);
+      out[j].clear();
+      AppendPred(&preds[begin], end - begin, binary, &out[j]);
+    }
+    for (int j = 0; j < nb; ++j) {
+      utils::Check(fwrite(out[j].c_str(), 1, out[j].length(), fo) == out[j].length(),
+                   "cannot write prediction to %s", fname);
+    }
+  }
+  fclose(fo);
+}
+}  // namespace io
+}  // namespace xgboost
+#endif  // XGBOOST_IO_PRED_OUTPUT_H_
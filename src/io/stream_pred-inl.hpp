@@ -0,0 +1,295 @@
+#ifndef XGBOOST_IO_STREAM_PRED_INL_HPP_
+#define XGBOOST_IO_STREAM_PRED_INL_HPP_
+/*!
+ * \file stream_pred-inl.hpp
+ * \brief streaming prediction of LibSVM text file in bounded memory,
+ *   a reader thread cuts the file into chunks of whole lines, worker threads parse and
+ *   score the chunks, and the predictions are written out in the order of input
+ */
+#include <pthread.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../utils/omp.h"
+#include "../utils/utils.h"
+#include "../learner/learner-inl.hpp"
+#include "./simple_dmatrix-inl.hpp"
+#include "./pred_output.h"
+
+namespace xgboost {
+namespace io {
+/*! \brief streaming predictor, only a bounded number of chunks are kept in memory */
+class StreamPredictor {
+ public:
+  typedef learner::BoostLearner<FMatrixS> Learner;
+  StreamPredictor(void) {
+    pred_margin = 0;
+    ntree_limit = 0;
+    silent = 0;
+    binary = 0;
+    budget_mb = 256;
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+  ~StreamPredictor(void) {
+    pthread_mutex_destroy(&mutex_);
+    pthread_cond_destroy(&cond_);
+  }
+  /*!
+   * \brief set parameters
+   * \param name name of the parameter
+   * \param val value of the parameter
+   */
+  inline void SetParam(const char *name, const char *val) {
+    if (!strcmp(name, "pred_margin")) pred_margin = atoi(val);
+    if (!strcmp(name, "ntree_limit")) ntree_limit = atoi(val);
+    if (!strcmp(name, "silent")) silent = atoi(val);
+    if (!strcmp(name, "pred_stream_mb")) budget_mb = std::max(atoi(val), 1);
+    if (!strcmp(name, "pred_format")) binary = !strcmp(val, "binary");
+  }
+  /*!
+   * \brief predict every row of a text file, the file is never loaded as a whole
+   * \param learner the model, only thread-safe prediction of it is used
+   * \param fname LibSVM text file to be predicted
+   * \param fname_out output file, in the same format as WritePred
+   * \return number of rows predicted
+   */
+  inline size_t Run(const Learner &learner, const char *fname, const char *fname_out) {
+    this->CheckInput(fname);
+    int nthread;
+    #pragma omp parallel
+    {
+      nthread = omp_get_num_threads();
+    }
+    // each worker has one chunk in hand and one chunk waiting, the rest of the budget
+    // is taken by the parsed rows and formatted output, which are of similar size
+    max_chunk_ = 2 * static_cast<size_t>(nthread) + 1;
+    chunk_bytes_ = std::max((static_cast<size_t>(budget_mb) << 20) / (2 * max_chunk_),
+                            static_cast<size_t>(kMinChunkBytes));
+    learner_ = &learner;
+    fi_ = utils::FopenCheck(fname, "rb");
+    FILE *fo = utils::FopenCheck(fname_out, binary != 0 ? "wb" : "w");
+    eof_ = false;
+    next_work_ = 0;
+    pthread_t reader;
+    std::vector<pthread_t> workers(nthread);
+    utils::Check(pthread_create(&reader, NULL, ReadThread, this) == 0,
+                 "cannot create reader thread");
+    for (int i = 0; i < nthread; ++i) {
+      utils::Check(pthread_create(&workers[i], NULL, WorkThread, this) == 0,
+                   "cannot create worker thread");
+    }
+    // write the chunks out in the order they are read
+    size_t nrow = 0;
+    while (true) {
+      pthread_mutex_lock(&mutex_);
+      while (!(queue_.size() != 0 && queue_.front()->done) && !(eof_ && queue_.size() == 0)) {
+        pthread_cond_wait(&cond_, &mutex_);
+      }
+      if (queue_.size() == 0) {
+        pthread_mutex_unlock(&mutex_); break;
+      }
+      Chunk *chunk = queue_.front();
+      queue_.pop_front();
+      next_work_ -= 1;
+      pthread_cond_broadcast(&cond_);
+      pthread_mutex_unlock(&mutex_);
+      if (chunk->out.length() != 0) {
+        utils::Check(fwrite(chunk->out.c_str(), 1, chunk->out.length(), fo) ==
+                     chunk->out.length(), "cannot write prediction to %s", fname_out);
+      }
+      nrow += chunk->num_row;
+      delete chunk;
+    }
+    pthread_join(reader, NULL);
+    for (int i = 0; i < nthread; ++i) {
+      pthread_join(workers[i], NULL);
+    }
+    fclose(fi_);
+    fclose(fo);
+    if (silent == 0) {
+      printf("%lu rows are predicted from %s in streaming mode\n",
+             static_cast<unsigned long>(nrow), fname);
+    }
+    return nrow;
+  }
+
+ private:
+  /*! \brief a chunk of whole lines of the input */
+  struct Chunk {
+    /*! \brief text of the lines, released after parsing */
+    std::string text;
+    /*! \brief formatted predictions of the lines */
+    std::string out;
+    /*! \brief number of rows in the chunk */
+    size_t num_row;
+    /*! \brief whether out is ready */
+    bool done;
+    Chunk(void) : num_row(0), done(false) {}
+  };
+  // the rows are only seen once, so information loaded from side files is not supported
+  inline static void CheckInput(const char *fname) {
+    FILE *fi = utils::FopenCheck(fname, "rb");
+    int magic;
+    const bool binary = fread(&magic, sizeof(magic), 1, fi) == 1 &&
+        magic == DMatrixSimple::kMagic;
+    fclose(fi);
+    utils::Check(!binary, "pred_stream: %s is a binary buffer, only text input is supported",
+                 fname);
+    std::string mname = std::string(fname) + ".base_margin";
+    fi = fopen64(mname.c_str(), "r");
+    if (fi != NULL) fclose(fi);
+    utils::Check(fi == NULL, "pred_stream: base_margin file %s is not supported",
+                 mname.c_str());
+  }
+  inline static void *ReadThread(void *arg) {
+    static_cast<StreamPredictor*>(arg)->ReadLoop();
+    return NULL;
+  }
+  inline static void *WorkThread(void *arg) {
+    static_cast<StreamPredictor*>(arg)->WorkLoop();
+    return NULL;
+  }
+  // cut the input into chunks of about chunk_bytes_, a chunk always ends at end of line
+  inline void ReadLoop(void) {
+    std::vector<char> buf(chunk_bytes_);
+    std::string rest;
+    bool eof = false;
+    while (!eof) {
+      pthread_mutex_lock(&mutex_);
+      while (queue_.size() >= max_chunk_) {
+        pthread_cond_wait(&cond_, &mutex_);
+      }
+      pthread_mutex_unlock(&mutex_);
+      Chunk *chunk = new Chunk();
+      chunk->text.swap(rest);
+      size_t end = std::string::npos;
+      while (end == std::string::npos) {
+        const size_t n = fread(&buf[0], 1, buf.size(), fi_);
+        if (n == 0) {
+          eof = true; break;
+        }
+        const size_t start = chunk->text.length();
+        chunk->text.append(&buf[0], n);
+        for (size_t i = n; i != 0; --i) {
+          if (buf[i - 1] == '\n') {
+            end = start + i; break;
+          }
+        }
+      }
+      if (!eof) {
+        rest.assign(chunk->text, end, std::string::npos);
+        chunk->text.resize(end);
+      }
+      pthread_mutex_lock(&mutex_);
+      if (chunk->text.length() != 0) {
+        queue_.push_back(chunk);
+      } else {
+        delete chunk;
+      }
+      eof_ = eof;
+      pthread_cond_broadcast(&cond_);
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+  // parse and predict the chunks in turn, each worker predicts in a single thread
+  inline void WorkLoop(void) {
+    omp_set_num_threads(1);
+    while (true) {
+      pthread_mutex_lock(&mutex_);
+      while (next_work_ == queue_.size() && !eof_) {
+        pthread_cond_wait(&cond_, &mutex_);
+      }
+      if (next_work_ == queue_.size()) {
+        pthread_mutex_unlock(&mutex_); return;
+      }
+      Chunk *chunk = queue_[next_work_++];
+      pthread_mutex_unlock(&mutex_);
+      this->Predict(chunk);
+      pthread_mutex_lock(&mutex_);
+      chunk->done = true;
+      pthread_cond_broadcast(&cond_);
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+  inline void Predict(Chunk *chunk) const {
+    DMatrixSimple dmat;
+    ParseText(chunk->text, &dmat);
+    std::string().swap(chunk->text);
+    std::vector<float> preds;
+    if (ntree_limit != 0) {
+      learner_->PredictStaged(dmat, pred_margin != 0,
+                              std::vector<unsigned>(1, static_cast<unsigned>(ntree_limit)),
+                              &preds);
+    } else {
+      learner_->PredictNoBuffer(dmat, pred_margin != 0, &preds);
+    }
+    chunk->num_row = dmat.info.num_row;
+    if (preds.size() != 0) {
+      AppendPred(&preds[0], preds.size(), binary != 0, &chunk->out);
+    }
+  }
+  // parse the lines in the same way as DMatrixSimple::LoadText, a token of
+  // the form index:value is a feature, other tokens are labels that start new rows
+  inline static void ParseText(const std::string &text, DMatrixSimple *dmat) {
+    std::vector<SparseBatch::Entry> feats;
+    bool init = true;
+    const char *p = text.c_str();
+    while (true) {
+      while (isspace(static_cast<unsigned char>(*p))) ++p;
+      if (*p == '\0') break;
+      char *end;
+      SparseBatch::Entry e;
+      e.findex = static_cast<bst_uint>(strtoul(p, &end, 10));
+      if (end != p && *end == ':') {
+        e.fvalue = strtof(end + 1, &end);
+        feats.push_back(e);
+      } else {
+        if (!init) dmat->AddRow(feats);
+        feats.clear();
+        strtof(p, &end);
+        utils::Check(end != p, "invalid LibSVM format");
+        init = false;
+      }
+      for (p = end; *p != '\0' && !isspace(static_cast<unsigned char>(*p)); ++p) {}
+    }
+    if (!init) dmat->AddRow(feats);
+  }
+  /*! \brief smallest size of a chunk */
+  static const size_t kMinChunkBytes = 64 << 10;
+  /*!\brief whether to directly output margin value */
+  int pred_margin;
+  /*! \brief number of boosting rounds used in prediction, 0 means all the rounds */
+  int ntree_limit;
+  /*! \brief whether silent */
+  int silent;
+  /*! \brief whether to output raw float32 values instead of text */
+  int binary;
+  /*! \brief memory budget of the chunks in MB */
+  int budget_mb;
+  /*! \brief the model */
+  const Learner *learner_;
+  /*! \brief input file */
+  FILE *fi_;
+  /*! \brief size of the text of a chunk */
+  size_t chunk_bytes_;
+  /*! \brief maximum number of chunks read but not yet written */
+  size_t max_chunk_;
+  /*! \brief chunks read but not yet written, in the order of input */
+  std::deque<Chunk*> queue_;
+  /*! \brief position in queue_ of the first chunk not taken by workers */
+  size_t next_work_;
+  /*! \brief whether the reader reaches end of file */
+  bool eof_;
+  /*! \brief lock of the queue, and the condition signaled whenever the queue changes */
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+};
+}  // namespace io
+}  // namespace xgboost
+#endif  // XGBOOST_IO_STREAM_PRED_INL_HPP_
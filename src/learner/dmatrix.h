@@ -136,15 +136,24 @@ struct DMatrix {
   MetaInfo info;
   /*! \brief feature matrix about data content */
   FMatrix fmat;
-  /*! 
-   * \brief cache pointer to verify if the data structure is cached in some learner
-   *  used to verify if DMatrix is cached
+  /*!
+   * \brief unique id of the object, used by learners as key of prediction cache,
+   *  unlike the address, it is never reused by a later object
    */
-  void *cache_learner_ptr_;
+  const size_t cache_id;
   /*! \brief default constructor */
-  explicit DMatrix(int magic) : magic(magic), cache_learner_ptr_(NULL) {}
+  explicit DMatrix(int magic) : magic(magic), cache_id(NewCacheId()) {}
   // virtual destructor
   virtual ~DMatrix(void){}
+
+ private:
+  inline static size_t NewCacheId(void) {
+    static size_t counter = 0;
+    size_t id;
+    #pragma omp atomic capture
+    id = ++counter;
+    return id;
+  }
 };
 
 }  // namespace learner
@@ -11,31 +11,36 @@
 namespace xgboost {
 namespace learner {
 // simple helper function to do softmax
-inline static void Softmax(std::vector<float>* p_rec) {
-  std::vector<float> &rec = *p_rec;
+inline static void Softmax(float *rec, size_t len) {
   float wmax = rec[0];
-  for (size_t i = 1; i < rec.size(); ++i) {
+  for (size_t i = 1; i < len; ++i) {
     wmax = std::max(rec[i], wmax);
   }
   double wsum = 0.0f;
-  for (size_t i = 0; i < rec.size(); ++i) {
+  for (size_t i = 0; i < len; ++i) {
     rec[i] = std::exp(rec[i]-wmax);
     wsum += rec[i];
   }
-  for (size_t i = 0; i < rec.size(); ++i) {
+  for (size_t i = 0; i < len; ++i) {
     rec[i] /= static_cast<float>(wsum);
   }
 }
+inline static void Softmax(std::vector<float>* p_rec) {
+  Softmax(&(*p_rec)[0], p_rec->size());
+}
 // simple helper function to do softmax
-inline static int FindMaxIndex(const std::vector<float>& rec) {
+inline static int FindMaxIndex(const float *rec, size_t len) {
   size_t mxid = 0;
-  for (size_t i = 1; i < rec.size(); ++i) {
+  for (size_t i = 1; i < len; ++i) {
     if (rec[i] > rec[mxid] + 1e-6f) {
       mxid = i;
     }
   }
   return static_cast<int>(mxid);
 }
+inline static int FindMaxIndex(const std::vector<float>& rec) {
+  return FindMaxIndex(&rec[0], rec.size());
+}
 
 inline static bool CmpFirst(const std::pair<float, unsigned> &a,
                             const std::pair<float, unsigned> &b) {
@@ -7,8 +7,10 @@
  */
 #include <algorithm>
 #include <vector>
+#include <map>
 #include <utility>
 #include <string>
+#include <sstream>
 #include <limits>
 #include "./objective.h"
 #include "./evaluation.h"
@@ -27,51 +29,41 @@ class BoostLearner {
   BoostLearner(void) {
     obj_ = NULL;
     gbm_ = NULL;
+    model_file_ = NULL;
     name_obj_ = "reg:linear";
     name_gbm_ = "gbtree";
     silent= 0;
     prob_buffer_row = 1.0f;
+    col_run = 0;
+    pred_cache_mb = 256;
+    cache_clock_ = 0;
   }
   ~BoostLearner(void) {
     if (obj_ != NULL) delete obj_;
     if (gbm_ != NULL) delete gbm_;
+    // gbm may use the mapped model file in place
+    if (model_file_ != NULL) delete model_file_;
   }
   /*!
-   * \brief add internal cache space for mat, this can speedup prediction for matrix,
-   *        please cache prediction for training and eval data
-   *    warning: if the model is loaded from file from some previous training history
-   *             set cache data must be called with exactly SAME 
-   *             data matrices to continue training otherwise it will cause error
+   * \brief register matrices that will be used in training and evaluation,
+   *  the number of features of the model is set to cover all of them,
+   *  it can be called again to add more matrices later in training,
+   *  prediction of these matrices is cached, matrices that are not registered are
+   *  cached when first predicted, see PredictRaw
    * \param mats array of pointers to matrix whose prediction result need to be cached
-   */          
+   */
   inline void SetCacheData(const std::vector<DMatrix<FMatrix>*>& mats) {
     // estimate feature bound
     unsigned num_feature = 0;
-    // assign buffer index
-    size_t buffer_size = 0;
-    utils::Assert(cache_.size() == 0, "can only call cache data once");
     for (size_t i = 0; i < mats.size(); ++i) {
-      bool dupilicate = false;
-      for (size_t j = 0; j < i; ++j) {
-        if (mats[i] == mats[j]) dupilicate = true;
-      }
-      if (dupilicate) continue;
-      // set mats[i]'s cache learner pointer to this
-      mats[i]->cache_learner_ptr_ = this;
-      cache_.push_back(CacheEntry(mats[i], buffer_size, mats[i]->info.num_row));
-      buffer_size += mats[i]->info.num_row;
+      this->TouchCache(mats[i]->cache_id);
       num_feature = std::max(num_feature, static_cast<unsigned>(mats[i]->info.num_col));
     }
-    char str_temp[25];
     if (num_feature > mparam.num_feature) {
+      char str_temp[25];
       snprintf(str_temp, sizeof(str_temp), "%u", num_feature);
       this->SetParam("bst:num_feature", str_temp);
     }
-    snprintf(str_temp, sizeof(str_temp), "%lu", buffer_size);
-    this->SetParam("num_pbuffer", str_temp);
-    if (!silent) {
-      printf("buffer_size=%ld\n", buffer_size);
-    }
   }
   /*!
    * \brief set parameters from outside
@@ -81,6 +73,8 @@ class BoostLearner {
   inline void SetParam(const char *name, const char *val) {
     if (!strcmp(name, "silent")) silent = atoi(val);
     if (!strcmp(name, "prob_buffer_row")) prob_buffer_row = static_cast<float>(atof(val));
+    if (!strcmp(name, "col_run")) col_run = atoi(val);
+    if (!strcmp(name, "pred_cache_mb")) pred_cache_mb = std::max(atoi(val), 0);
     if (!strcmp(name, "eval_metric")) evaluator_.AddEval(val);
     if (!strcmp("seed", name)) random::Seed(atoi(val));
     if (!strcmp(name, "num_class")) this->SetParam("num_output_group", val);
@@ -108,6 +102,7 @@ class BoostLearner {
     mparam.base_score = obj_->ProbToMargin(mparam.base_score);
     // initialize GBM model
     gbm_->InitModel();
+    this->ClearCache();
   }
   /*!
    * \brief load model from stream
@@ -123,15 +118,30 @@ class BoostLearner {
     if (gbm_ != NULL) delete gbm_;
     this->InitObjGBM();
     gbm_->LoadModel(fi);
+    this->ClearCache();
+    // the previous model file is no longer used by gbm
+    if (model_file_ != NULL && model_file_ != &fi) {
+      delete model_file_; model_file_ = NULL;
+    }
   }
   /*!
-   * \brief load model from file
+   * \brief load model from file, the file is memory mapped if possible,
+   *   and kept alive if the model uses it in place
    * \param fname file name
    */
   inline void LoadModel(const char *fname) {
-    utils::FileStream fi(utils::FopenCheck(fname, "rb"));
-    this->LoadModel(fi);
-    fi.Close();
+    utils::MMapStream *fi = new utils::MMapStream(fname);
+    // the file is owned by the learner before loading, so it is released with the learner
+    // even if the error handler leaves loading halfway, the previous gbm may use the old file
+    if (gbm_ != NULL) {
+      delete gbm_; gbm_ = NULL;
+    }
+    if (model_file_ != NULL) delete model_file_;
+    model_file_ = fi;
+    this->LoadModel(*fi);
+    if (!fi->mapped()) {
+      delete fi; model_file_ = NULL;
+    }
   }
   inline void SaveModel(utils::IStream &fo) const {
     fo.Write(&mparam, sizeof(ModelParam));
@@ -140,10 +150,22 @@ class BoostLearner {
     gbm_->SaveModel(fo);
   }
   /*!
-   * \brief save model into file
+   * \brief save model into file, an existing regular file is replaced by renaming
+   *  a new file over it, as other learners may have the old file mapped in memory
    * \param fname file name
    */
   inline void SaveModel(const char *fname) const {
+#ifndef _WIN32
+    struct stat st;
+    if (stat(fname, &st) == 0 && S_ISREG(st.st_mode)) {
+      std::string tmp = std::string(fname) + ".tmp";
+      utils::FileStream fo(utils::FopenCheck(tmp.c_str(), "wb"));
+      this->SaveModel(fo);
+      fo.Close();
+      utils::Check(rename(tmp.c_str(), fname) == 0, "can not rename %s to %s", tmp.c_str(), fname);
+      return;
+    }
+#endif
     utils::FileStream fo(utils::FopenCheck(fname, "wb"));
     this->SaveModel(fo);
     fo.Close();
@@ -154,7 +176,7 @@ class BoostLearner {
    * \param p_train pointer to the matrix used by training
    */
   inline void CheckInit(DMatrix<FMatrix> *p_train) {
-    p_train->fmat.InitColAccess(prob_buffer_row);
+    p_train->fmat.InitColAccess(prob_buffer_row, col_run != 0);
   }
   /*!
    * \brief update the model for one iteration
@@ -202,6 +224,10 @@ class BoostLearner {
     delete ev;
     return std::make_pair(metric, res);
   }
+  /*! \return number of features of the model, larger feature index must not be predicted */
+  inline unsigned NumFeature(void) const {
+    return mparam.num_feature;
+  }
   /*!
    * \brief get prediction
    * \param data input data
@@ -216,10 +242,187 @@ class BoostLearner {
       obj_->PredTransform(out_preds);
     }
   }
+  /*!
+   * \brief thread-safe prediction, the prediction buffer of cached data is neither used
+   *  nor updated and the learner is not modified, so a loaded model can be shared by
+   *  many threads, as long as each thread predicts on its own data matrix,
+   *  the model must be loaded or initialized before
+   * \param data input data
+   * \param output_margin whether to only predict margin value instead of transformed prediction
+   * \param out_preds output vector that stores the prediction
+   */
+  inline void PredictNoBuffer(const DMatrix<FMatrix> &data,
+                              bool output_margin,
+                              std::vector<float> *out_preds) const {
+    utils::Check(gbm_ != NULL, "PredictNoBuffer: model is not initialized");
+    this->PredictRaw(data, out_preds, false);
+    if (!output_margin) {
+      obj_->PredTransform(out_preds);
+    }
+  }
+  /*!
+   * \brief staged prediction, the predictions after several numbers of boosting rounds
+   *  are computed in one pass over the model, the prediction buffer is not used
+   * \param data input data
+   * \param output_margin whether to only predict margin value instead of transformed prediction
+   * \param stages numbers of boosting rounds in increasing order, 0 means all the rounds
+   * \param out_preds output vector, the predictions of a row are stored together,
+   *   ordered by stage, each stage takes the same space as prediction of the row in Predict
+   */
+  inline void PredictStaged(const DMatrix<FMatrix> &data,
+                            bool output_margin,
+                            const std::vector<unsigned> &stages,
+                            std::vector<float> *out_preds) const {
+    const gbm::IGradBooster<FMatrix> *gbm = gbm_;
+    gbm->PredictStaged(data.fmat, data.info.info, stages, out_preds);
+    this->AddBaseMargin(data, stages.size(), out_preds);
+    if (!output_margin) {
+      obj_->PredTransform(out_preds);
+    }
+  }
+  /*!
+   * \brief feature contributions of the prediction, the margin of each row and output group
+   *  is split into the contribution of each feature and a bias term, which includes base margin
+   * \param data input data
+   * \param out_contrib output vector, each row and output group takes num_feature + 1 values,
+   *   the last of which is the bias term, the values sum to the margin of the prediction
+   */
+  inline void PredictContrib(const DMatrix<FMatrix> &data,
+                             std::vector<float> *out_contrib) const {
+    const gbm::IGradBooster<FMatrix> *gbm = gbm_;
+    gbm->PredictContrib(data.fmat, data.info.info, out_contrib);
+    const size_t nout = data.info.num_row * gbm_->NumOutputGroup();
+    if (nout == 0) return;
+    const size_t stride = out_contrib->size() / nout;
+    for (size_t i = 0; i < nout; ++i) {
+      (*out_contrib)[i * stride + stride - 1] += this->BaseMargin(data, i);
+    }
+  }
+  /*!
+   * \brief sparse version of PredictContrib, only the features on the decision paths are output
+   * \param data input data
+   * \param out_ptr the contributions of row i and output group g are stored in
+   *   [out_ptr[i * ngroup + g], out_ptr[i * ngroup + g + 1]) of out_contrib
+   * \param out_contrib the contributions in increasing order of feature index,
+   *   the bias term is always the last one, with index num_feature
+   */
+  inline void PredictContrib(const DMatrix<FMatrix> &data,
+                             std::vector<size_t> *out_ptr,
+                             std::vector<SparseBatch::Entry> *out_contrib) const {
+    const gbm::IGradBooster<FMatrix> *gbm = gbm_;
+    gbm->PredictContrib(data.fmat, data.info.info, out_ptr, out_contrib);
+    for (size_t i = 0; i + 1 < out_ptr->size(); ++i) {
+      (*out_contrib)[(*out_ptr)[i + 1] - 1].fvalue += this->BaseMargin(data, i);
+    }
+  }
+  /*!
+   * \brief predict a single instance, without prediction buffer and parallel region
+   * \param inst the instance to be predicted
+   * \param output_margin whether to only predict margin value instead of transformed prediction
+   * \param out_preds output array, must have space of one value per output group
+   * \return number of values written to out_preds
+   */
+  inline size_t PredictRow(const SparseBatch::Inst &inst, bool output_margin,
+                           float *out_preds) const {
+    size_t len = static_cast<size_t>(gbm_->PredictRow(inst, 0, out_preds));
+    for (size_t j = 0; j < len; ++j) {
+      out_preds[j] += mparam.base_score;
+    }
+    if (!output_margin) {
+      len = obj_->PredTransformRow(out_preds, len);
+    }
+    return len;
+  }
+  /*!
+   * \brief predict data by several models in one pass, each row is filled into a dense
+   *  feature vector once and then scored by all the models, the prediction buffer is not used
+   * \param learners the models, each must give the same number of outputs per row
+   * \param data input data
+   * \param output_margin whether to only predict margin value instead of transformed prediction
+   * \param out_preds output vector, the predictions of a row are stored together,
+   *   ordered by model, each model takes the same space as prediction of the row in Predict
+   */
+  inline static void PredictMulti(const std::vector<const BoostLearner*> &learners,
+                                  const DMatrix<FMatrix> &data,
+                                  bool output_margin,
+                                  std::vector<float> *out_preds) {
+    const size_t nmodel = learners.size();
+    utils::Check(nmodel != 0, "PredictMulti: no model is given");
+    unsigned stride = 1;
+    for (size_t m = 0; m < nmodel; ++m) {
+      stride = std::max(stride, learners[m]->mparam.num_feature);
+    }
+    std::vector< std::vector<float> > margin(nmodel);
+    // a dense row does not fit in cache, predict by each model separately
+    if (stride > kMultiMaxFeature) {
+      for (size_t m = 0; m < nmodel; ++m) {
+        learners[m]->PredictNoBuffer(data, output_margin, &margin[m]);
+      }
+    } else {
+      PredictMultiMargin(learners, data, stride, &margin);
+      for (size_t m = 0; m < nmodel; ++m) {
+        learners[m]->AddBaseMargin(data, 1, &margin[m]);
+        if (!output_margin) {
+          learners[m]->obj_->PredTransform(&margin[m]);
+        }
+      }
+    }
+    const size_t nrow = data.info.num_row;
+    const size_t nout = nrow == 0 ? 0 : margin[0].size() / nrow;
+    for (size_t m = 0; m < nmodel; ++m) {
+      utils::Check(margin[m].size() == nrow * nout,
+                   "PredictMulti: models give different number of outputs per row");
+    }
+    std::vector<float> &preds = *out_preds;
+    preds.resize(nrow * nmodel * nout);
+    for (size_t m = 0; m < nmodel; ++m) {
+      for (size_t i = 0; i < nrow; ++i) {
+        std::copy(&margin[m][0] + i * nout, &margin[m][0] + (i + 1) * nout,
+                  &preds[0] + (i * nmodel + m) * nout);
+      }
+    }
+  }
   /*! \brief dump model out */
   inline std::vector<std::string> DumpModel(const utils::FeatMap& fmap, int option) {
     return gbm_->DumpModel(fmap, option);
   }
+  /*!
+   * \brief generate standalone C source of the model, with base_score and
+   *  PredTransform folded in, the source defines void predict(const float *feat, float *out)
+   * \param output_margin whether to only output margin value instead of transformed prediction
+   * \return the generated source
+   */
+  inline std::string GenerateCode(bool output_margin) const {
+    int ngroup;
+    const std::string margin = gbm_->GenerateCode("xgboost_margin", &ngroup);
+    std::string transform;
+    int nout = ngroup;
+    if (!output_margin) {
+      nout = obj_->GenerateTransformCode(ngroup, &transform);
+    }
+    std::stringstream fo("");
+    fo << "/*\n"
+       << " * generated by xgboost task=compile, objective=" << name_obj_ << "\n"
+       << " * build: cc -O2 -shared -fPIC model.c -o model.so -lm\n"
+       << " * predict(feat, out): feat is dense feature vector, NaN means missing value,\n"
+       << " *   out receives " << nout << " value(s)\n"
+       << " */\n"
+       << "#include <math.h>\n\n"
+       << margin << '\n'
+       << "void predict(const float *feat, float *out) {\n"
+       << "  float preds[" << ngroup << "];\n"
+       << "  int i;\n"
+       << "  xgboost_margin(feat, preds);\n"
+       << "  for (i = 0; i < " << ngroup << "; ++i) {\n"
+       << "    preds[i] += " << utils::FloatToCode(mparam.base_score) << ";\n"
+       << "  }\n"
+       << transform
+       << "  for (i = 0; i < " << nout << "; ++i) {\n"
+       << "    out[i] = preds[i];\n"
+       << "  }\n"
+       << "}\n";
+    return fo.str();
+  }
 
  protected:
   /*! 
@@ -241,20 +444,109 @@ class BoostLearner {
    * \brief get un-transformed prediction
    * \param data training data matrix
    * \param out_preds output vector that stores the prediction
+   * \param use_buffer whether to use and update prediction cache of data, the matrix gets
+   *   an entry when first predicted, the cache of each matrix keeps the prediction
+   *   of the model when it is last predicted,
+   *   so only trees added after that are visited
    */
   inline void PredictRaw(const DMatrix<FMatrix> &data,
-                         std::vector<float> *out_preds) const {
-    gbm_->Predict(data.fmat, this->FindBufferOffset(data),
-                  data.info.info, out_preds);
-    // add base margin
+                         std::vector<float> *out_preds,
+                         bool use_buffer = true) const {
+    // the cache is not visited without buffer, so that concurrent const prediction is safe
+    typename std::map<size_t, CacheEntry>::iterator it = cache_.end();
+    if (use_buffer && pred_cache_mb != 0) it = this->TouchCache(data.cache_id);
+    if (it != cache_.end()) {
+      CacheEntry &e = it->second;
+      if (e.num_row != data.info.num_row) {
+        e.buffer = gbm::PredBuffer();
+        e.num_row = data.info.num_row;
+      }
+      gbm_->Predict(data.fmat, data.info.info, &e.buffer, out_preds);
+      this->ShrinkCache();
+    } else {
+      const gbm::IGradBooster<FMatrix> *gbm = gbm_;
+      gbm->Predict(data.fmat, data.info.info, out_preds);
+    }
+    this->AddBaseMargin(data, 1, out_preds);
+  }
+  /*!
+   * \brief raw prediction of several models, rows are filled into a dense block
+   *  that stays in cache, and the block is predicted by each model in turn
+   * \param stride number of entries of each dense row, larger than number of features of models
+   * \param out_margin the prediction of each model, in the same layout as PredictRaw
+   */
+  inline static void PredictMultiMargin(const std::vector<const BoostLearner*> &learners,
+                                        const DMatrix<FMatrix> &data, unsigned stride,
+                                        std::vector< std::vector<float> > *out_margin) {
+    const size_t nmodel = learners.size();
+    std::vector< std::vector<float> > &margin = *out_margin;
+    for (size_t m = 0; m < nmodel; ++m) {
+      margin[m].resize(data.info.num_row * learners[m]->gbm_->NumOutputGroup());
+    }
+    const unsigned row_block = static_cast<unsigned>(
+        std::max(std::min(kMultiCacheBytes / (stride * sizeof(float)), kMultiRowBlock),
+                 static_cast<size_t>(1)));
+    int nthread;
+    #pragma omp parallel
+    {
+      nthread = omp_get_num_threads();
+    }
+    std::vector<tree::RegTree::FVec::Entry>
+        dense(static_cast<size_t>(nthread) * row_block * stride);
+    std::vector<unsigned> root(static_cast<size_t>(nthread) * row_block);
+    utils::IIterator<SparseBatch> *iter = data.fmat.RowIterator();
+    iter->BeforeFirst();
+    while (iter->Next()) {
+      const SparseBatch &batch = iter->Value();
+      const unsigned nsize = static_cast<unsigned>(batch.size);
+      const unsigned nblock = (nsize + row_block - 1) / row_block;
+      #pragma omp parallel for schedule(static)
+      for (unsigned j = 0; j < nblock; ++j) {
+        const int tid = omp_get_thread_num();
+        const unsigned begin = j * row_block;
+        const unsigned end = std::min(nsize, begin + row_block);
+        tree::RegTree::FVec::Entry *pdense = &dense[static_cast<size_t>(tid) * row_block * stride];
+        unsigned *proot = &root[static_cast<size_t>(tid) * row_block];
+        tree::RegTree::FVec::Entry missing;
+        missing.flag = -1;
+        std::fill(pdense, pdense + static_cast<size_t>(end - begin) * stride, missing);
+        for (unsigned i = begin; i < end; ++i) {
+          const SparseBatch::Inst inst = batch[i];
+          tree::RegTree::FVec::Entry *row = pdense + static_cast<size_t>(i - begin) * stride;
+          // features unknown to all the models are never used
+          for (bst_uint k = 0; k < inst.length; ++k) {
+            if (inst[k].findex < stride) row[inst[k].findex].fvalue = inst[k].fvalue;
+          }
+          proot[i - begin] = data.info.info.GetRoot(batch.base_rowid + i);
+        }
+        for (size_t m = 0; m < nmodel; ++m) {
+          const size_t ngroup = static_cast<size_t>(learners[m]->gbm_->NumOutputGroup());
+          learners[m]->gbm_->PredictDense(pdense, end - begin, stride, proot,
+                                          &margin[m][(batch.base_rowid + begin) * ngroup]);
+        }
+      }
+    }
+  }
+  // base margin of output i, which is row i / ngroup and output group i % ngroup
+  inline float BaseMargin(const DMatrix<FMatrix> &data, size_t i) const {
+    return data.info.base_margin.size() != 0 ? data.info.base_margin[i] : mparam.base_score;
+  }
+  /*!
+   * \brief add base margin to raw prediction
+   * \param nstage number of values of each row and output group, given by staged prediction
+   */
+  inline void AddBaseMargin(const DMatrix<FMatrix> &data, size_t nstage,
+                            std::vector<float> *out_preds) const {
     std::vector<float> &preds = *out_preds;
     const unsigned ndata = static_cast<unsigned>(preds.size());
     if (data.info.base_margin.size() != 0) {
-      utils::Check(preds.size() == data.info.base_margin.size(),
+      utils::Check(preds.size() == data.info.base_margin.size() * nstage,
                    "base_margin.size does not match with prediction size");
+      const size_t ngroup = data.info.base_margin.size() / std::max(data.info.num_row,
+                                                                     static_cast<size_t>(1));
       #pragma omp parallel for schedule(static)
       for (unsigned j = 0; j < ndata; ++j) {
-        preds[j] += data.info.base_margin[j];
+        preds[j] += data.info.base_margin[j / (nstage * ngroup) * ngroup + j % ngroup];
       }
     } else {
       #pragma omp parallel for schedule(static)
@@ -297,12 +589,17 @@ class BoostLearner {
   int silent;
   // maximum buffred row value
   float prob_buffer_row;
+  // whether store low cardinality columns as runs of equal values during column access,
+  // off by default, it only pays off when most entries of a column fall in long runs
+  int col_run;
   // evaluation set
   EvalSet evaluator_;
   // model parameter
   ModelParam   mparam;
   // gbm model that back everything
   gbm::IGradBooster<FMatrix> *gbm_;
+  // mapped model file used in place by gbm_, NULL if not used
+  utils::MMapStream *model_file_;
   // name of gbm model used for training
   std::string name_gbm_;
   // objective fnction
@@ -317,28 +614,76 @@ class BoostLearner {
   std::vector<bst_gpair> gpair_;
 
  private:
-  // cache entry object that helps handle feature caching
+  // cache entry that keeps prediction of a data matrix
   struct CacheEntry {
-    const DMatrix<FMatrix> *mat_;
-    size_t buffer_offset_;
-    size_t num_row_;
-    CacheEntry(const DMatrix<FMatrix> *mat, size_t buffer_offset, size_t num_row)
-        :mat_(mat), buffer_offset_(buffer_offset), num_row_(num_row) {}
+    /*! \brief number of rows of the matrix the buffer is built for */
+    size_t num_row;
+    /*! \brief value of cache_clock_ when the entry is last used */
+    size_t last_use;
+    /*! \brief prediction buffer of the matrix */
+    gbm::PredBuffer buffer;
+    CacheEntry(void) : num_row(0), last_use(0) {}
+    inline void Clear(void) {
+      buffer = gbm::PredBuffer(); num_row = 0;
+    }
   };
-  // find internal bufer offset for certain matrix, if not exist, return -1
-  inline int64_t FindBufferOffset(const DMatrix<FMatrix> &mat) const {
-    for (size_t i = 0; i < cache_.size(); ++i) {
-      if (cache_[i].mat_ == &mat && mat.cache_learner_ptr_ == this) {
-        if (cache_[i].num_row_ == mat.info.num_row) {
-          return cache_[i].buffer_offset_;
-        }
+  // drop the prediction of all the matrices, called when the model is replaced
+  inline void ClearCache(void) {
+    for (typename std::map<size_t, CacheEntry>::iterator it = cache_.begin();
+         it != cache_.end(); ++it) {
+      it->second.Clear();
+    }
+  }
+  // get the cache entry of the matrix, added if not exist, and mark it as recently used,
+  // at most kMaxCacheEntry matrices are kept, the ones not used for long are likely freed
+  inline typename std::map<size_t, CacheEntry>::iterator TouchCache(size_t cache_id) const {
+    typename std::map<size_t, CacheEntry>::iterator entry =
+        cache_.insert(std::make_pair(cache_id, CacheEntry())).first;
+    entry->second.last_use = ++cache_clock_;
+    if (cache_.size() > kMaxCacheEntry) {
+      typename std::map<size_t, CacheEntry>::iterator lru = cache_.begin();
+      for (typename std::map<size_t, CacheEntry>::iterator it = cache_.begin();
+           it != cache_.end(); ++it) {
+        if (it->second.last_use < lru->second.last_use) lru = it;
+      }
+      cache_.erase(lru);
+    }
+    return entry;
+  }
+  // drop the prediction of least recently used matrices until the cache fits in pred_cache_mb,
+  // the matrices stay registered and are predicted again from scratch when used
+  inline void ShrinkCache(void) const {
+    const size_t budget = static_cast<size_t>(pred_cache_mb) << 20;
+    size_t total = 0;
+    for (typename std::map<size_t, CacheEntry>::const_iterator it = cache_.begin();
+         it != cache_.end(); ++it) {
+      total += it->second.buffer.MemCostBytes();
+    }
+    while (total > budget) {
+      typename std::map<size_t, CacheEntry>::iterator lru = cache_.end();
+      for (typename std::map<size_t, CacheEntry>::iterator it = cache_.begin();
+           it != cache_.end(); ++it) {
+        if (it->second.buffer.MemCostBytes() == 0) continue;
+        if (lru == cache_.end() || it->second.last_use < lru->second.last_use) lru = it;
       }
+      total -= lru->second.buffer.MemCostBytes();
+      lru->second.Clear();
     }
-    return -1;
   }
-  // data structure field
-  /*! \brief the entries indicates that we have internal prediction cache */
-  std::vector<CacheEntry> cache_;
+  // maximum size of prediction cache in MB, 0 means prediction is not cached
+  int pred_cache_mb;
+  // prediction cache of data matrices, indexed by DMatrix::cache_id
+  mutable std::map<size_t, CacheEntry> cache_;
+  // number of cache accesses, used as time of LRU eviction
+  mutable size_t cache_clock_;
+  // maximum number of matrices kept in prediction cache
+  static const size_t kMaxCacheEntry = 64;
+  // size of dense block of rows kept in cache by PredictMulti
+  static const size_t kMultiCacheBytes = 256 << 10;
+  // maximum number of rows in dense block of PredictMulti
+  static const size_t kMultiRowBlock = 64;
+  // PredictMulti falls back to separate prediction if one dense row exceeds the block
+  static const unsigned kMultiMaxFeature = kMultiCacheBytes / sizeof(float);
 };
 }  // namespace learner
 }  // namespace xgboost
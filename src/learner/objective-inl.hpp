@@ -6,6 +6,8 @@
  * \author Tianqi Chen, Kailong Chen
  */
 #include <vector>
+#include <string>
+#include <sstream>
 #include <cmath>
 #include <algorithm>
 #include <utility>
@@ -41,6 +43,16 @@ struct LossType {
       default: utils::Error("unknown loss_type"); return 0.0f;
     }
   }
+  /*! \brief C expression of PredTransform given C expression of x */
+  inline std::string PredTransformCode(const std::string &x) const {
+    switch (loss_type) {
+      case kLogisticRaw:
+      case kLinearSquare: return x;
+      case kLogisticClassify:
+      case kLogisticNeglik: return "1.0f / (1.0f + expf(-" + x + "))";
+      default: utils::Error("unknown loss_type"); return x;
+    }
+  }
   /*!
    * \brief calculate first order gradient of loss, given transformed prediction
    * \param predt transformed prediction
@@ -138,9 +150,23 @@ class RegLossObj : public IObjFunction{
       preds[j] = loss.PredTransform(preds[j]);
     }
   }
+  virtual size_t PredTransformRow(float *io_preds, size_t len) const {
+    for (size_t j = 0; j < len; ++j) {
+      io_preds[j] = loss.PredTransform(io_preds[j]);
+    }
+    return len;
+  }
   virtual float ProbToMargin(float base_score) const {
     return loss.ProbToMargin(base_score);
   }
+  virtual int GenerateTransformCode(int ngroup, std::string *out_code) const {
+    std::stringstream fo("");
+    fo << "  for (i = 0; i < " << ngroup << "; ++i) {\n"
+       << "    preds[i] = " << loss.PredTransformCode("preds[i]") << ";\n"
+       << "  }\n";
+    *out_code += fo.str();
+    return ngroup;
+  }
 
  protected:
   float scale_pos_weight;
@@ -201,9 +227,54 @@ class SoftmaxMultiClassObj : public IObjFunction {
   virtual void EvalTransform(std::vector<float> *io_preds) {
     this->Transform(io_preds, 0);
   }
+  virtual size_t PredTransformRow(float *io_preds, size_t len) const {
+    utils::Check(nclass != 0 && len == static_cast<size_t>(nclass),
+                 "must set num_class to use softmax");
+    if (output_prob == 0) {
+      io_preds[0] = static_cast<float>(FindMaxIndex(io_preds, len));
+      return 1;
+    } else {
+      Softmax(io_preds, len);
+      return len;
+    }
+  }
   virtual const char* DefaultEvalMetric(void) const {
     return "merror";
   }
+  virtual int GenerateTransformCode(int ngroup, std::string *out_code) const {
+    utils::Check(nclass == ngroup, "must set num_class to use softmax");
+    std::stringstream fo("");
+    if (output_prob == 0) {
+      // same as FindMaxIndex
+      fo << "  {\n"
+         << "    int mxid = 0;\n"
+         << "    for (i = 1; i < " << nclass << "; ++i) {\n"
+         << "      if (preds[i] > preds[mxid] + 1e-6f) mxid = i;\n"
+         << "    }\n"
+         << "    preds[0] = (float)mxid;\n"
+         << "  }\n";
+      *out_code += fo.str();
+      return 1;
+    } else {
+      // same as Softmax
+      fo << "  {\n"
+         << "    float wmax = preds[0];\n"
+         << "    double wsum = 0.0;\n"
+         << "    for (i = 1; i < " << nclass << "; ++i) {\n"
+         << "      if (!(preds[i] < wmax)) wmax = preds[i];\n"
+         << "    }\n"
+         << "    for (i = 0; i < " << nclass << "; ++i) {\n"
+         << "      preds[i] = expf(preds[i] - wmax);\n"
+         << "      wsum += preds[i];\n"
+         << "    }\n"
+         << "    for (i = 0; i < " << nclass << "; ++i) {\n"
+         << "      preds[i] /= (float)wsum;\n"
+         << "    }\n"
+         << "  }\n";
+      *out_code += fo.str();
+      return nclass;
+    }
+  }
 
  private:
   inline void Transform(std::vector<float> *io_preds, int prob) {
@@ -39,6 +39,16 @@ class IObjFunction{
    * \param io_preds prediction values, saves to this vector as well
    */
   virtual void PredTransform(std::vector<float> *io_preds){}
+  /*!
+   * \brief transform prediction values of a single instance, used by single row prediction,
+   *  it should not start parallel region
+   * \param io_preds prediction values of the instance, saves to this array as well
+   * \param len number of prediction values of the instance
+   * \return number of prediction values after transformation
+   */
+  virtual size_t PredTransformRow(float *io_preds, size_t len) const {
+    return len;
+  }
   /*!
    * \brief transform prediction values, this is only called when Eval is called, 
    *  usually it redirect to PredTransform
@@ -56,6 +66,16 @@ class IObjFunction{
   virtual float ProbToMargin(float base_score) const {
     return base_score;
   }
+  /*!
+   * \brief generate C statements of PredTransform for a single instance,
+   *  the statements transform float array preds in place, used by model compiler
+   * \param ngroup number of margin values of the instance
+   * \param out_code the generated statements are appended to out_code
+   * \return number of output values after transformation
+   */
+  virtual int GenerateTransformCode(int ngroup, std::string *out_code) const {
+    return ngroup;
+  }
 };
 }  // namespace learner
 }  // namespace xgboost
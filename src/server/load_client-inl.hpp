@@ -0,0 +1,149 @@
+#ifndef XGBOOST_SERVER_LOAD_CLIENT_INL_HPP_
+#define XGBOOST_SERVER_LOAD_CLIENT_INL_HPP_
+/*!
+ * \file load_client-inl.hpp
+ * \brief client of prediction server, includes a closed loop load generator
+ *   that replays rows of a data file from many connections and reports latency
+ */
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "./protocol.h"
+#include "../io/io.h"
+
+namespace xgboost {
+namespace server {
+/*! \brief client of prediction server */
+class LoadClient {
+ public:
+  LoadClient(void) {
+    socket_path = "xgboost.sock";
+    num_client = 4;
+    num_request = 10000;
+    silent = 0;
+  }
+  /*!
+   * \brief set parameters from outside
+   * \param name name of the parameter
+   * \param val value of the parameter
+   */
+  inline void SetParam(const char *name, const char *val) {
+    if (!strcmp(name, "socket")) socket_path = val;
+    if (!strcmp(name, "num_client")) num_client = std::max(atoi(val), 1);
+    if (!strcmp(name, "num_request")) num_request = std::max(atoi(val), 1);
+    if (!strcmp(name, "silent")) silent = atoi(val);
+  }
+  /*!
+   * \brief replay rows of data from num_client connections,
+   *  each connection sends num_request requests one after another
+   * \param data_path data file whose rows are sent as requests
+   */
+  inline void Bench(const char *data_path) {
+    io::DataMatrix *data = io::LoadDataMatrix(data_path, silent != 0, false);
+    rows_.clear();
+    utils::IIterator<SparseBatch> *iter = data->fmat.RowIterator();
+    iter->BeforeFirst();
+    while (iter->Next()) {
+      const SparseBatch &batch = iter->Value();
+      for (size_t i = 0; i < batch.size; ++i) {
+        rows_.push_back(std::vector<SparseBatch::Entry>(batch[i].data,
+                                                        batch[i].data + batch[i].length));
+      }
+    }
+    delete data;
+    utils::Check(rows_.size() != 0, "no rows in %s", data_path);
+    std::vector<Worker> workers(num_client);
+    std::vector<pthread_t> threads(num_client);
+    const double start = GetTime();
+    for (int i = 0; i < num_client; ++i) {
+      workers[i].client = this; workers[i].rank = i;
+      utils::Check(pthread_create(&threads[i], NULL, WorkerThread, &workers[i]) == 0,
+                   "cannot create client thread");
+    }
+    LogHistogram latency;
+    for (int i = 0; i < num_client; ++i) {
+      pthread_join(threads[i], NULL);
+      latency.Merge(workers[i].latency);
+    }
+    const double elapsed = GetTime() - start;
+    printf("clients=%d requests=%lu elapsed=%.3f sec throughput=%.1f req/sec\n",
+           num_client, static_cast<unsigned long>(latency.Size()), elapsed,
+           latency.Size() / elapsed);
+    printf("latency(us): %s\n%s", latency.Summary().c_str(), latency.Dump().c_str());
+  }
+  /*!
+   * \brief ask server to reload model
+   * \param fname model file, must be accessible by the server
+   */
+  inline void Reload(const char *fname) {
+    int fd = Connect(socket_path.c_str());
+    unsigned msg[2] = {kReload, static_cast<unsigned>(strlen(fname))};
+    utils::Check(WriteAll(fd, msg, sizeof(msg)) && WriteAll(fd, fname, msg[1]),
+                 "connection to server closed");
+    int status;
+    utils::Check(ReadAll(fd, &status, sizeof(status)), "connection to server closed");
+    close(fd);
+    utils::Check(status == 0, "server failed to load %s", fname);
+    printf("server now uses %s\n", fname);
+  }
+  /*! \brief print statistics of server */
+  inline void Stats(void) {
+    int fd = Connect(socket_path.c_str());
+    unsigned type = kStats, len;
+    utils::Check(WriteAll(fd, &type, sizeof(type)) && ReadAll(fd, &len, sizeof(len)),
+                 "connection to server closed");
+    std::string text(len, '\0');
+    utils::Check(len == 0 || ReadAll(fd, &text[0], len), "connection to server closed");
+    close(fd);
+    printf("%s", text.c_str());
+  }
+
+ private:
+  /*! \brief state of a load generator thread */
+  struct Worker {
+    LoadClient *client;
+    int rank;
+    LogHistogram latency;
+  };
+  inline static void *WorkerThread(void *arg) {
+    Worker *w = static_cast<Worker*>(arg);
+    w->client->Replay(w->rank, &w->latency);
+    return NULL;
+  }
+  // send requests one after another, rows are assigned to clients in round robin
+  inline void Replay(int rank, LogHistogram *latency) const {
+    int fd = Connect(socket_path.c_str());
+    std::vector<float> preds;
+    size_t ridx = static_cast<size_t>(rank) % rows_.size();
+    for (int i = 0; i < num_request; ++i) {
+      const std::vector<SparseBatch::Entry> &row = rows_[ridx];
+      unsigned msg[2] = {kPredict, static_cast<unsigned>(row.size())};
+      const double start = GetTime();
+      utils::Check(WriteAll(fd, msg, sizeof(msg)), "connection to server closed");
+      utils::Check(row.size() == 0 ||
+                   WriteAll(fd, &row[0], sizeof(SparseBatch::Entry) * row.size()),
+                   "connection to server closed");
+      unsigned nout;
+      utils::Check(ReadAll(fd, &nout, sizeof(nout)), "connection to server closed");
+      preds.resize(nout);
+      utils::Check(nout == 0 || ReadAll(fd, &preds[0], sizeof(float) * nout),
+                   "connection to server closed");
+      latency->Add((GetTime() - start) * 1e6);
+      ridx = (ridx + num_client) % rows_.size();
+    }
+    close(fd);
+  }
+  /*! \brief path of the unix domain socket */
+  std::string socket_path;
+  /*! \brief number of concurrent connections */
+  int num_client;
+  /*! \brief number of requests sent by each connection */
+  int num_request;
+  /*! \brief whether silent */
+  int silent;
+  /*! \brief rows to be sent */
+  std::vector< std::vector<SparseBatch::Entry> > rows_;
+};
+}  // namespace server
+}  // namespace xgboost
+#endif  // XGBOOST_SERVER_LOAD_CLIENT_INL_HPP_
@@ -0,0 +1,344 @@
+#ifndef XGBOOST_SERVER_PRED_SERVER_INL_HPP_
+#define XGBOOST_SERVER_PRED_SERVER_INL_HPP_
+/*!
+ * \file pred_server-inl.hpp
+ * \brief long lived prediction server over unix domain socket,
+ *   concurrent requests are coalesced into micro batches and scored by the batch
+ *   prediction path of the learner, the model can be reloaded without stopping the server
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <cerrno>
+#include <deque>
+#include <string>
+#include <vector>
+#include <utility>
+#include "./protocol.h"
+#include "../learner/learner-inl.hpp"
+#include "../io/simple_dmatrix-inl.hpp"
+
+namespace xgboost {
+namespace server {
+/*! \brief prediction server */
+class PredServer {
+ public:
+  PredServer(void) {
+    learner_ = pending_ = NULL;
+    max_batch = 64;
+    max_delay_us = 200;
+    pred_margin = 0;
+    silent = 0;
+    socket_path = "xgboost.sock";
+    num_request_ = num_batch_ = 0;
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&queue_cond_, NULL);
+    pthread_cond_init(&done_cond_, NULL);
+    // create the key before any other thread starts
+    LoadKey();
+  }
+  ~PredServer(void) {
+    if (learner_ != NULL) delete learner_;
+    if (pending_ != NULL) delete pending_;
+    pthread_mutex_destroy(&mutex_);
+    pthread_cond_destroy(&queue_cond_);
+    pthread_cond_destroy(&done_cond_);
+  }
+  /*!
+   * \brief set parameters, parameters other than server ones are passed to the learner
+   * \param name name of the parameter
+   * \param val value of the parameter
+   */
+  inline void SetParam(const char *name, const char *val) {
+    if (!strcmp(name, "socket")) socket_path = val;
+    if (!strcmp(name, "max_batch")) max_batch = std::max(atoi(val), 1);
+    if (!strcmp(name, "max_delay_us")) max_delay_us = std::max(atoi(val), 0);
+    if (!strcmp(name, "pred_margin")) pred_margin = atoi(val);
+    if (!strcmp(name, "silent")) silent = atoi(val);
+    cfg_.push_back(std::make_pair(std::string(name), std::string(val)));
+  }
+  /*!
+   * \brief load the model and serve requests forever
+   * \param model_in the model to be served
+   */
+  inline void Run(const char *model_in) {
+    learner_ = this->LoadLearner(model_in);
+    utils::Check(learner_ != NULL, "cannot load model file %s", model_in);
+    signal(SIGPIPE, SIG_IGN);
+    sockaddr_un addr;
+    InitAddress(socket_path.c_str(), &addr);
+    unlink(socket_path.c_str());
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    utils::Check(sock >= 0, "cannot create socket");
+    utils::Check(bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0,
+                 "cannot bind socket %s", socket_path.c_str());
+    utils::Check(listen(sock, 128) == 0, "cannot listen on socket %s", socket_path.c_str());
+    pthread_t batcher;
+    utils::Check(pthread_create(&batcher, NULL, BatchThread, this) == 0,
+                 "cannot create batch thread");
+    if (silent == 0) {
+      printf("serving %s at %s, max_batch=%d, max_delay_us=%d\n",
+             model_in, socket_path.c_str(), max_batch, max_delay_us);
+      fflush(stdout);
+    }
+    while (true) {
+      int fd = accept(sock, NULL, NULL);
+      if (fd < 0) {
+        if (errno == EINTR) continue;
+        utils::Error("accept failed");
+      }
+      Connection *conn = new Connection();
+      conn->server = this; conn->fd = fd;
+      pthread_t tid;
+      utils::Check(pthread_create(&tid, NULL, ConnectionThread, conn) == 0,
+                   "cannot create connection thread");
+      pthread_detach(tid);
+    }
+  }
+  /*!
+   * \brief handler of fatal errors in the server, an error in loading a model
+   *  only fails the load, other errors print the message and exit
+   * \param msg the error message
+   */
+  inline static void HandleError(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    if (pthread_getspecific(LoadKey()) != NULL) throw LoadError();
+    exit(-1);
+  }
+
+ private:
+  typedef learner::BoostLearner<FMatrixS> Learner;
+  /*! \brief a pending prediction request */
+  struct Request {
+    /*! \brief features of the row */
+    std::vector<SparseBatch::Entry> feats;
+    /*! \brief predictions of the row */
+    std::vector<float> preds;
+    /*! \brief arrival time */
+    double start;
+    /*! \brief whether the prediction is ready */
+    bool done;
+  };
+  /*! \brief thrown by HandleError to leave a failed model load */
+  struct LoadError {};
+  /*! \brief argument of connection thread */
+  struct Connection {
+    PredServer *server;
+    int fd;
+  };
+  // key of thread specific flag, set when errors of the thread only fail the model load
+  inline static pthread_key_t LoadKey(void) {
+    static pthread_key_t key = CreateKey();
+    return key;
+  }
+  inline static pthread_key_t CreateKey(void) {
+    pthread_key_t key;
+    if (pthread_key_create(&key, NULL) != 0) {
+      fprintf(stderr, "cannot create thread key\n"); exit(-1);
+    }
+    return key;
+  }
+  // create learner from model file, return NULL if the file cannot be opened or is invalid
+  inline Learner *LoadLearner(const char *fname) const {
+    FILE *fi = fopen64(fname, "rb");
+    if (fi == NULL) return NULL;
+    fclose(fi);
+    Learner *learner = new Learner();
+    for (size_t i = 0; i < cfg_.size(); ++i) {
+      learner->SetParam(cfg_[i].first.c_str(), cfg_[i].second.c_str());
+    }
+    pthread_setspecific(LoadKey(), learner);
+    try {
+      learner->LoadModel(fname);
+    } catch (const LoadError &) {
+      delete learner; learner = NULL;
+    }
+    pthread_setspecific(LoadKey(), NULL);
+    return learner;
+  }
+  inline static void *ConnectionThread(void *arg) {
+    Connection *conn = static_cast<Connection*>(arg);
+    conn->server->Serve(conn->fd);
+    close(conn->fd);
+    delete conn;
+    return NULL;
+  }
+  inline static void *BatchThread(void *arg) {
+    static_cast<PredServer*>(arg)->BatchLoop();
+    return NULL;
+  }
+  // serve requests from one connection until it is closed
+  inline void Serve(int fd) {
+    unsigned type;
+    Request req;
+    while (ReadAll(fd, &type, sizeof(type))) {
+      switch (type) {
+        case kPredict: {
+          unsigned nnz;
+          if (!ReadAll(fd, &nnz, sizeof(nnz)) || nnz > kMaxRowLength) return;
+          req.feats.resize(nnz);
+          if (nnz != 0 && !ReadAll(fd, &req.feats[0], sizeof(SparseBatch::Entry) * nnz)) return;
+          this->Predict(&req);
+          unsigned nout = static_cast<unsigned>(req.preds.size());
+          if (!WriteAll(fd, &nout, sizeof(nout))) return;
+          if (nout != 0 && !WriteAll(fd, &req.preds[0], sizeof(float) * nout)) return;
+          break;
+        }
+        case kReload: {
+          unsigned len;
+          if (!ReadAll(fd, &len, sizeof(len))) return;
+          std::string fname(len, '\0');
+          if (len != 0 && !ReadAll(fd, &fname[0], len)) return;
+          int status = this->Reload(fname.c_str());
+          if (!WriteAll(fd, &status, sizeof(status))) return;
+          break;
+        }
+        case kStats: {
+          std::string text = this->Stats();
+          unsigned len = static_cast<unsigned>(text.length());
+          if (!WriteAll(fd, &len, sizeof(len))) return;
+          if (!WriteAll(fd, text.c_str(), len)) return;
+          break;
+        }
+        default: return;
+      }
+    }
+  }
+  // put request into queue and wait until it is scored
+  inline void Predict(Request *req) {
+    req->done = false;
+    pthread_mutex_lock(&mutex_);
+    req->start = GetTime();
+    queue_.push_back(req);
+    pthread_cond_signal(&queue_cond_);
+    while (!req->done) {
+      pthread_cond_wait(&done_cond_, &mutex_);
+    }
+    latency_.Add((GetTime() - req->start) * 1e6);
+    num_request_ += 1;
+    pthread_mutex_unlock(&mutex_);
+  }
+  // load the new model, it is swapped in by batch thread between two batches
+  inline int Reload(const char *fname) {
+    Learner *learner = this->LoadLearner(fname);
+    if (learner == NULL) return -1;
+    pthread_mutex_lock(&mutex_);
+    if (pending_ != NULL) delete pending_;
+    pending_ = learner;
+    pthread_cond_signal(&queue_cond_);
+    pthread_mutex_unlock(&mutex_);
+    if (silent == 0) {
+      printf("reload model %s\n", fname); fflush(stdout);
+    }
+    return 0;
+  }
+  inline std::string Stats(void) {
+    pthread_mutex_lock(&mutex_);
+    char buf[256];
+    snprintf(buf, sizeof(buf), "requests=%lu batches=%lu mean_batch=%.2f\n",
+             static_cast<unsigned long>(num_request_), static_cast<unsigned long>(num_batch_),
+             num_batch_ == 0 ? 0.0 : static_cast<double>(num_request_) / num_batch_);
+    std::string ret = buf;
+    ret += "latency(us): " + latency_.Summary() + "\n" + latency_.Dump();
+    ret += "batch size: " + batch_size_.Summary() + "\n";
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+  }
+  // wait on queue condition until deadline given in monotonic time
+  inline void WaitUntil(double deadline) {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double wait = deadline - GetTime();
+    if (wait <= 0.0) return;
+    double sec = static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9 + wait;
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(sec);
+    ts.tv_nsec = static_cast<long>((sec - static_cast<double>(ts.tv_sec)) * 1e9);
+    pthread_cond_timedwait(&queue_cond_, &mutex_, &ts);
+  }
+  // collect requests into micro batch, and score them together
+  inline void BatchLoop(void) {
+    std::vector<Request*> batch;
+    std::vector<float> preds;
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (queue_.empty() && pending_ == NULL) {
+        pthread_cond_wait(&queue_cond_, &mutex_);
+      }
+      // swap in the reloaded model, no batch is in flight here
+      if (pending_ != NULL) {
+        delete learner_;
+        learner_ = pending_;
+        pending_ = NULL;
+      }
+      if (queue_.empty()) continue;
+      // wait for more requests, until batch is full or the oldest request waits too long
+      const double deadline = queue_.front()->start + max_delay_us * 1e-6;
+      while (queue_.size() < static_cast<size_t>(max_batch) && GetTime() < deadline) {
+        this->WaitUntil(deadline);
+      }
+      batch.clear();
+      while (!queue_.empty() && batch.size() < static_cast<size_t>(max_batch)) {
+        batch.push_back(queue_.front());
+        queue_.pop_front();
+      }
+      pthread_mutex_unlock(&mutex_);
+      // features unknown to the model are dropped, the model in use is only known here
+      const unsigned nfeat = learner_->NumFeature();
+      io::DMatrixSimple dmat;
+      for (size_t i = 0; i < batch.size(); ++i) {
+        std::vector<SparseBatch::Entry> &feats = batch[i]->feats;
+        size_t n = 0;
+        for (size_t j = 0; j < feats.size(); ++j) {
+          if (feats[j].findex < nfeat) feats[n++] = feats[j];
+        }
+        feats.resize(n);
+        dmat.AddRow(feats);
+      }
+      learner_->PredictNoBuffer(dmat, pred_margin != 0, &preds);
+      const size_t nout = preds.size() / batch.size();
+      for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->preds.assign(preds.begin() + i * nout, preds.begin() + (i + 1) * nout);
+      }
+      pthread_mutex_lock(&mutex_);
+      for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->done = true;
+      }
+      num_batch_ += 1;
+      batch_size_.Add(static_cast<double>(batch.size()));
+      pthread_cond_broadcast(&done_cond_);
+    }
+  }
+  /*! \brief maximum number of requests in a batch */
+  int max_batch;
+  /*! \brief maximum time the first request of a batch waits for more requests */
+  int max_delay_us;
+  /*! \brief whether to output margin value */
+  int pred_margin;
+  /*! \brief whether silent */
+  int silent;
+  /*! \brief path of the unix domain socket */
+  std::string socket_path;
+  /*! \brief configurations passed to learner */
+  std::vector< std::pair<std::string, std::string> > cfg_;
+  /*! \brief learner in use, only accessed by batch thread after startup */
+  Learner *learner_;
+  /*! \brief reloaded learner waiting to be swapped in */
+  Learner *pending_;
+  /*! \brief lock of the fields below */
+  pthread_mutex_t mutex_;
+  /*! \brief signaled when new request or reloaded model arrives */
+  pthread_cond_t queue_cond_;
+  /*! \brief signaled when a batch is scored */
+  pthread_cond_t done_cond_;
+  /*! \brief requests waiting to be scored */
+  std::deque<Request*> queue_;
+  /*! \brief latency of requests seen by the server */
+  LogHistogram latency_;
+  /*! \brief histogram of batch size */
+  LogHistogram batch_size_;
+  /*! \brief number of requests and batches scored */
+  size_t num_request_, num_batch_;
+};
+}  // namespace server
+}  // namespace xgboost
+#endif  // XGBOOST_SERVER_PRED_SERVER_INL_HPP_
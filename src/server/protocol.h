@@ -0,0 +1,165 @@
+#ifndef XGBOOST_SERVER_PROTOCOL_H_
+#define XGBOOST_SERVER_PROTOCOL_H_
+/*!
+ * \file protocol.h
+ * \brief wire protocol of the prediction server over unix domain socket,
+ *   and helpers shared by the server and the load generator client
+ *
+ *  every message starts with an unsigned 32 bit request type, followed by
+ *    kPredict: nnz, then nnz pairs of (unsigned findex, float fvalue),
+ *              nnz is at most kMaxRowLength, features the model does not have are ignored
+ *              reply: number of outputs n, then n floats
+ *    kReload:  length of model path, then the path
+ *              reply: int status, 0 means the new model is in use
+ *    kStats:   no content
+ *              reply: length of text, then the text of server statistics
+ */
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../utils/utils.h"
+
+namespace xgboost {
+/*! \brief namespace of prediction server */
+namespace server {
+/*! \brief type of request */
+enum RequestType {
+  kPredict = 0,
+  kReload = 1,
+  kStats = 2
+};
+/*! \brief maximum number of entries of a row in kPredict, the connection is closed if exceeded */
+const unsigned kMaxRowLength = 1U << 20;
+/*! \brief read exactly size bytes from fd, return false if the connection is closed */
+inline bool ReadAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char*>(buf);
+  while (size != 0) {
+    ssize_t n = read(fd, p, size);
+    if (n <= 0) return false;
+    p += n; size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+/*! \brief write exactly size bytes to fd, return false if the connection is closed */
+inline bool WriteAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char*>(buf);
+  while (size != 0) {
+    ssize_t n = write(fd, p, size);
+    if (n <= 0) return false;
+    p += n; size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+/*! \brief fill the address of unix domain socket */
+inline void InitAddress(const char *path, sockaddr_un *addr) {
+  memset(addr, 0, sizeof(sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  utils::Check(strlen(path) < sizeof(addr->sun_path), "socket path too long: %s", path);
+  strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+}
+/*! \brief connect to server at path, return the socket */
+inline int Connect(const char *path) {
+  sockaddr_un addr;
+  InitAddress(path, &addr);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  utils::Check(fd >= 0, "cannot create socket");
+  utils::Check(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0,
+               "cannot connect to server at %s", path);
+  return fd;
+}
+/*! \return monotonic time in seconds */
+inline double GetTime(void) {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+/*!
+ * \brief histogram of positive values such as latency in microseconds,
+ *  buckets are spaced in log scale, with kSubBucket buckets per power of two
+ */
+class LogHistogram {
+ public:
+  /*! \brief number of buckets per power of two */
+  static const int kSubBucket = 4;
+  /*! \brief number of buckets, covers values up to 2^32 */
+  static const int kNumBucket = 32 * kSubBucket;
+  LogHistogram(void) {
+    this->Clear();
+  }
+  /*! \brief clear the histogram */
+  inline void Clear(void) {
+    count.clear(); count.resize(kNumBucket, 0);
+    num = 0; sum = 0.0; max_value = 0.0;
+  }
+  /*! \brief add a record */
+  inline void Add(double value) {
+    int b = value < 1.0 ? 0 : static_cast<int>(std::log(value) / std::log(2.0) * kSubBucket) + 1;
+    count[std::min(b, kNumBucket - 1)] += 1;
+    num += 1; sum += value;
+    max_value = std::max(max_value, value);
+  }
+  /*! \brief merge another histogram into this one */
+  inline void Merge(const LogHistogram &other) {
+    for (int i = 0; i < kNumBucket; ++i) {
+      count[i] += other.count[i];
+    }
+    num += other.num; sum += other.sum;
+    max_value = std::max(max_value, other.max_value);
+  }
+  /*! \return number of records */
+  inline size_t Size(void) const {
+    return num;
+  }
+  /*! \return upper bound of the bucket that holds quantile q */
+  inline double Quantile(double q) const {
+    const double target = q * num;
+    size_t acc = 0;
+    for (int i = 0; i < kNumBucket; ++i) {
+      acc += count[i];
+      if (acc != 0 && acc >= target) return std::min(UpperBound(i), max_value);
+    }
+    return max_value;
+  }
+  /*! \return one line summary of the histogram */
+  inline std::string Summary(void) const {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "n=%lu mean=%.1f p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f",
+             static_cast<unsigned long>(num), num == 0 ? 0.0 : sum / num,
+             Quantile(0.5), Quantile(0.9), Quantile(0.99), Quantile(0.999), max_value);
+    return std::string(buf);
+  }
+  /*! \return text of all non-empty buckets, one bucket per line */
+  inline std::string Dump(void) const {
+    std::string ret;
+    for (int i = 0; i < kNumBucket; ++i) {
+      if (count[i] == 0) continue;
+      char buf[128];
+      snprintf(buf, sizeof(buf), "  <=%.1f\t%lu\n", UpperBound(i),
+               static_cast<unsigned long>(count[i]));
+      ret += buf;
+    }
+    return ret;
+  }
+
+ private:
+  inline static double UpperBound(int bucket) {
+    return bucket == 0 ? 1.0 : std::pow(2.0, static_cast<double>(bucket) / kSubBucket);
+  }
+  /*! \brief count of each bucket */
+  std::vector<size_t> count;
+  /*! \brief number of records */
+  size_t num;
+  /*! \brief sum of records */
+  double sum;
+  /*! \brief maximum record */
+  double max_value;
+};
+}  // namespace server
+}  // namespace xgboost
+#endif  // XGBOOST_SERVER_PROTOCOL_H_
@@ -0,0 +1,407 @@
+#ifndef XGBOOST_TREE_FLAT_ENSEMBLE_H_
+#define XGBOOST_TREE_FLAT_ENSEMBLE_H_
+/*!
+ * \file flat_ensemble.h
+ * \brief compact inference layout of an ensemble of regression trees,
+ *   all the nodes are stored in one contiguous array, used to speedup prediction,
+ *   the layout can also be saved and used in place from a memory mapped model file
+ */
+#include <vector>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include "./model.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XGBOOST_FLAT_AVX2 1
+#include <immintrin.h>
+#else
+#define XGBOOST_FLAT_AVX2 0
+#endif
+
+namespace xgboost {
+namespace tree {
+/*!
+ * \brief flattened ensemble of RegTree, nodes of each tree are stored in breadth-first order,
+ *  the two children of a node are always next to each other.
+ *  trees are appended in the same order as the model, and indexed by output group
+ */
+class FlatEnsemble {
+ public:
+  /*! \brief compact tree node used in inference */
+  struct Node {
+    /*! \brief index of left child in the ensemble, right child is cleft + 1, -1 if leaf */
+    int cleft;
+    /*! \brief split feature index, highest bit indicates whether missing value goes left */
+    unsigned sindex;
+    /*! \brief split condition of split node, or leaf value of leaf node */
+    float value;
+    /*! \brief whether current node is leaf node */
+    inline bool is_leaf(void) const {
+      return cleft == -1;
+    }
+    /*! \brief feature index of split condition */
+    inline unsigned split_index(void) const {
+      return sindex & ((1U << 31) - 1U);
+    }
+    /*! \brief when feature is unknown, whether goes to left child */
+    inline bool default_left(void) const {
+      return (sindex >> 31) != 0;
+    }
+    /*! \brief get next node index given feature value */
+    inline int GetNext(float fvalue, bool is_unknown) const {
+      if (is_unknown) {
+        return default_left() ? cleft : cleft + 1;
+      } else {
+        return fvalue < value ? cleft : cleft + 1;
+      }
+    }
+  };
+  /*! \brief number of rows traversed together by PredictTreeBatch */
+  static const int kBatchWidth = 8;
+  /*! \brief constructor */
+  FlatEnsemble(void) {
+    this->Clear();
+  }
+  /*! \brief clear the ensemble */
+  inline void Clear(void) {
+    node_store.clear();
+    ptr_store.clear();
+    ptr_store.push_back(0);
+    group_store.clear();
+    group_trees.clear();
+    this->UseStore();
+  }
+  /*! \return number of trees in the ensemble */
+  inline size_t NumTree(void) const {
+    return num_tree;
+  }
+  /*! \return number of nodes in the ensemble */
+  inline size_t NumNode(void) const {
+    return num_node;
+  }
+  /*! \return number of output groups that have trees */
+  inline size_t NumGroup(void) const {
+    return group_trees.size();
+  }
+  /*! \return index of trees that belong to output group, in model order */
+  inline const std::vector<unsigned> &GroupTrees(int bst_group) const {
+    return group_trees[bst_group];
+  }
+  /*! \return output group of tree tid */
+  inline int TreeGroup(size_t tid) const {
+    return tree_group[tid];
+  }
+  /*! \return index of the first node of tree tid, tree tid ends at TreeBegin(tid + 1) */
+  inline size_t TreeBegin(size_t tid) const {
+    return tree_ptr[tid];
+  }
+  /*! \brief get node given its index in the ensemble */
+  inline const Node &operator[](size_t nid) const {
+    return nodes[nid];
+  }
+  /*!
+   * \brief append a tree to the ensemble
+   * \param tree the tree to be appended
+   * \param bst_group output group of the tree
+   */
+  inline void AddTree(const RegTree &tree, int bst_group) {
+    this->Detach();
+    if (static_cast<size_t>(bst_group) >= group_trees.size()) {
+      group_trees.resize(bst_group + 1);
+    }
+    group_trees[bst_group].push_back(static_cast<unsigned>(this->NumTree()));
+    group_store.push_back(bst_group);
+    // breadth first order, roots go first
+    const int base = static_cast<int>(node_store.size());
+    std::vector<int> qnode;
+    for (int i = 0; i < tree.param.num_roots; ++i) {
+      qnode.push_back(i);
+    }
+    node_store.resize(node_store.size() + tree.param.num_roots);
+    for (size_t i = 0; i < qnode.size(); ++i) {
+      const RegTree::Node &src = tree[qnode[i]];
+      Node &dst = node_store[base + i];
+      if (src.is_leaf()) {
+        dst.cleft = -1;
+        dst.sindex = 0;
+        dst.value = src.leaf_value();
+      } else {
+        dst.cleft = base + static_cast<int>(qnode.size());
+        dst.sindex = src.split_index() | (src.default_left() ? (1U << 31) : 0U);
+        dst.value = src.split_cond();
+        qnode.push_back(src.cleft());
+        qnode.push_back(src.cright());
+        node_store.resize(node_store.size() + 2);
+      }
+    }
+    utils::Check(node_store.size() < UINT_MAX, "FlatEnsemble: too many nodes");
+    ptr_store.push_back(static_cast<unsigned>(node_store.size()));
+    this->UseStore();
+  }
+  /*!
+   * \brief save the ensemble, the arrays are aligned in the stream
+   *  so that they can be used in place when the file is memory mapped
+   * \param fo output stream
+   */
+  inline void SaveModel(utils::IStream &fo) const {
+    const char pad[sizeof(int)] = {0};
+    const unsigned npad = static_cast<unsigned>(
+        (sizeof(int) - (fo.Tell() + sizeof(npad)) % sizeof(int)) % sizeof(int));
+    fo.Write(&npad, sizeof(npad));
+    if (npad != 0) fo.Write(pad, npad);
+    if (num_tree != 0) fo.Write(tree_group, sizeof(int) * num_tree);
+    fo.Write(tree_ptr, sizeof(unsigned) * (num_tree + 1));
+    if (num_node != 0) fo.Write(nodes, sizeof(Node) * num_node);
+  }
+  /*!
+   * \brief load the ensemble saved by SaveModel, if the stream supports MapRead,
+   *  the arrays are used in place, and the stream must outlive the ensemble
+   * \param fi input stream
+   * \param ntree number of trees in the ensemble
+   * \param num_feature number of features, split indices of the nodes must be smaller
+   * \param num_group number of output groups, groups of the trees must be smaller
+   */
+  inline void LoadModel(utils::IStream &fi, size_t ntree, unsigned num_feature, int num_group) {
+    this->Clear();
+    unsigned npad;
+    char pad[sizeof(int)];
+    utils::Check(fi.Read(&npad, sizeof(npad)) != 0 && npad < sizeof(int),
+                 "FlatEnsemble: invalid model file");
+    utils::Check(npad == 0 || fi.Read(pad, npad) != 0, "FlatEnsemble: invalid model file");
+    num_tree = ntree;
+    tree_group = ReadArray(fi, ntree, &group_store);
+    tree_ptr = ReadArray(fi, ntree + 1, &ptr_store);
+    utils::Check(tree_ptr[0] == 0, "FlatEnsemble: invalid model file");
+    num_node = tree_ptr[ntree];
+    nodes = ReadArray(fi, num_node, &node_store);
+    for (size_t i = 0; i < ntree; ++i) {
+      utils::Check(tree_group[i] >= 0 && tree_group[i] < num_group &&
+                   tree_ptr[i] < tree_ptr[i + 1],
+                   "FlatEnsemble: invalid model file");
+      if (static_cast<size_t>(tree_group[i]) >= group_trees.size()) {
+        group_trees.resize(tree_group[i] + 1);
+      }
+      group_trees[tree_group[i]].push_back(static_cast<unsigned>(i));
+      // children must follow their parent inside the same tree, so traversal always ends,
+      // leaves keep sindex = 0 as the vectorized traversal gathers it
+      for (unsigned nid = tree_ptr[i]; nid < tree_ptr[i + 1]; ++nid) {
+        const Node &n = nodes[nid];
+        if (n.is_leaf()) {
+          utils::Check(n.sindex == 0, "FlatEnsemble: invalid model file");
+          continue;
+        }
+        utils::Check(n.cleft > static_cast<int>(nid) &&
+                     static_cast<unsigned>(n.cleft) + 1 < tree_ptr[i + 1] &&
+                     n.split_index() < num_feature,
+                     "FlatEnsemble: invalid model file");
+      }
+    }
+  }
+  /*!
+   * \brief get the leaf index of the tree
+   * \param tid index of tree in the ensemble
+   * \param feat feature vector, RegTree::FVec or RegTree::SparseFVec
+   * \param root_id starting root index of the instance
+   * \return leaf node index in the ensemble
+   */
+  template<typename TFVec>
+  inline int GetLeafIndex(size_t tid, const TFVec &feat, unsigned root_id = 0) const {
+    int pid = static_cast<int>(tree_ptr[tid] + root_id);
+    while (!nodes[pid].is_leaf()) {
+      const unsigned split_index = nodes[pid].split_index();
+      pid = nodes[pid].GetNext(feat.fvalue(split_index), feat.is_missing(split_index));
+    }
+    return pid;
+  }
+  // sparse feature vector looks up each split feature once for both value and missing
+  inline int GetLeafIndex(size_t tid, const RegTree::SparseFVec &feat,
+                          unsigned root_id = 0) const {
+    int pid = static_cast<int>(tree_ptr[tid] + root_id);
+    while (!nodes[pid].is_leaf()) {
+      const float *p = feat.Find(nodes[pid].split_index());
+      pid = nodes[pid].GetNext(p == NULL ? 0.0f : *p, p == NULL);
+    }
+    return pid;
+  }
+  /*!
+   * \brief predict the value of one tree
+   * \param tid index of tree in the ensemble
+   * \param feat feature vector, RegTree::FVec or RegTree::SparseFVec
+   * \param root_id starting root index of the instance
+   */
+  template<typename TFVec>
+  inline float PredictTree(size_t tid, const TFVec &feat, unsigned root_id = 0) const {
+    return nodes[this->GetLeafIndex(tid, feat, root_id)].value;
+  }
+  /*!
+   * \brief sum up prediction of trees in output group, whose index is no less than tbegin
+   * \param feat feature vector, RegTree::FVec or RegTree::SparseFVec
+   * \param bst_group output group
+   * \param tbegin index of first tree to be used in the model
+   * \param root_id starting root index of the instance
+   */
+  template<typename TFVec>
+  inline float PredictGroup(const TFVec &feat, int bst_group,
+                            size_t tbegin, unsigned root_id = 0) const {
+    if (static_cast<size_t>(bst_group) >= group_trees.size()) return 0.0f;
+    const std::vector<unsigned> &trees = group_trees[bst_group];
+    float psum = 0.0f;
+    for (size_t i = std::lower_bound(trees.begin(), trees.end(), tbegin) - trees.begin();
+         i < trees.size(); ++i) {
+      psum += this->PredictTree(trees[i], feat, root_id);
+    }
+    return psum;
+  }
+  /*!
+   * \brief add prediction of every tree to its output group, the row is visited once
+   *  for all the groups, trees of each group are summed up in model order as in PredictGroup
+   * \param feat feature vector, RegTree::FVec or RegTree::SparseFVec
+   * \param root_id starting root index of the instance
+   * \param out_preds prediction of each output group, has at least NumGroup() entries
+   */
+  template<typename TFVec>
+  inline void PredictAllGroups(const TFVec &feat, unsigned root_id, float *out_preds) const {
+    for (size_t i = 0; i < num_tree; ++i) {
+      out_preds[tree_group[i]] += this->PredictTree(i, feat, root_id);
+    }
+  }
+  /*!
+   * \brief whether PredictTreeBatch can run the vectorized kernel,
+   *   requires AVX2 on the running cpu and node index that fits in 32 bit gather
+   * \param num_row maximum number of rows in dense block passed to PredictTreeBatch
+   * \param stride number of features per row in the dense block
+   */
+  inline bool SupportSimd(size_t num_row, size_t stride) const {
+#if XGBOOST_FLAT_AVX2
+    static const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    return has_avx2 && num_node < INT_MAX / 3 && num_row * stride < INT_MAX;
+#else
+    return false;
+#endif
+  }
+  /*!
+   * \brief predict the value of one tree for kBatchWidth rows together
+   * \param tid index of tree in the ensemble
+   * \param dense row major dense features of the rows, each row takes stride entries,
+   *   missing value is marked by flag == -1 as in FVec
+   * \param stride number of entries per row in dense
+   * \param root_id starting root index of each row
+   * \param out_pred leaf value of each row
+   * \param simd whether to use vectorized kernel, must be checked by SupportSimd
+   */
+  inline void PredictTreeBatch(size_t tid, const RegTree::FVec::Entry *dense, unsigned stride,
+                               const unsigned root_id[kBatchWidth], float out_pred[kBatchWidth],
+                               bool simd) const {
+#if XGBOOST_FLAT_AVX2
+    if (simd) {
+      this->PredictTreeAVX2(tid, dense, stride, root_id, out_pred); return;
+    }
+#endif
+    for (int k = 0; k < kBatchWidth; ++k) {
+      const RegTree::FVec::Entry *row = dense + k * stride;
+      int pid = static_cast<int>(tree_ptr[tid] + root_id[k]);
+      while (!nodes[pid].is_leaf()) {
+        const unsigned split_index = nodes[pid].split_index();
+        pid = nodes[pid].GetNext(row[split_index].fvalue, row[split_index].flag == -1);
+      }
+      out_pred[k] = nodes[pid].value;
+    }
+  }
+
+ private:
+#if XGBOOST_FLAT_AVX2
+  /*!
+   * \brief vectorized version of PredictTreeBatch, each lane walks one row,
+   *  node fields and feature values are fetched by gather, child choice is done by blend,
+   *  lanes that reached leaf stay there until all lanes finish
+   */
+  __attribute__((target("avx2")))
+  inline void PredictTreeAVX2(size_t tid, const RegTree::FVec::Entry *dense, unsigned stride,
+                              const unsigned root_id[kBatchWidth],
+                              float out_pred[kBatchWidth]) const {
+    const int *pnode = reinterpret_cast<const int*>(nodes);
+    const int *pfeat = reinterpret_cast<const int*>(dense);
+    const __m256i kOne = _mm256_set1_epi32(1);
+    const __m256i kNone = _mm256_set1_epi32(-1);
+    const __m256i kNodeSize = _mm256_set1_epi32(sizeof(Node) / sizeof(int));
+    const __m256i kIndexMask = _mm256_set1_epi32((1U << 31) - 1U);
+    const __m256i row_offset =
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                           _mm256_set1_epi32(static_cast<int>(stride)));
+    __m256i pid = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(tree_ptr[tid])),
+                                   _mm256_loadu_si256(reinterpret_cast<const __m256i*>(root_id)));
+    while (true) {
+      const __m256i base = _mm256_mullo_epi32(pid, kNodeSize);
+      const __m256i cleft = _mm256_i32gather_epi32(pnode, base, 4);
+      const __m256i is_leaf = _mm256_cmpeq_epi32(cleft, kNone);
+      if (_mm256_movemask_epi8(is_leaf) == -1) break;
+      // leaf node has sindex = 0, the gather of feature 0 is harmless
+      const __m256i sindex = _mm256_i32gather_epi32(pnode + 1, base, 4);
+      const __m256 cond = _mm256_i32gather_ps(reinterpret_cast<const float*>(pnode + 2), base, 4);
+      const __m256i fidx = _mm256_add_epi32(row_offset, _mm256_and_si256(sindex, kIndexMask));
+      const __m256i fvalue = _mm256_i32gather_epi32(pfeat, fidx, 4);
+      const __m256i is_missing = _mm256_cmpeq_epi32(fvalue, kNone);
+      const __m256i is_less = _mm256_castps_si256(
+          _mm256_cmp_ps(_mm256_castsi256_ps(fvalue), cond, _CMP_LT_OQ));
+      // highest bit of sindex is default_left
+      const __m256i go_left = _mm256_blendv_epi8(is_less, _mm256_srai_epi32(sindex, 31),
+                                                 is_missing);
+      const __m256i next = _mm256_add_epi32(cleft, _mm256_andnot_si256(go_left, kOne));
+      pid = _mm256_blendv_epi8(next, pid, is_leaf);
+    }
+    const __m256 value = _mm256_i32gather_ps(reinterpret_cast<const float*>(pnode + 2),
+                                             _mm256_mullo_epi32(pid, kNodeSize), 4);
+    _mm256_storeu_ps(out_pred, value);
+  }
+#endif
+  // point the arrays to own storage
+  inline void UseStore(void) {
+    num_node = node_store.size();
+    num_tree = ptr_store.size() - 1;
+    nodes = num_node == 0 ? NULL : &node_store[0];
+    tree_ptr = &ptr_store[0];
+    tree_group = num_tree == 0 ? NULL : &group_store[0];
+  }
+  // copy the arrays used in place from the model file into own storage
+  inline void Detach(void) {
+    if (node_store.size() != num_node) node_store.assign(nodes, nodes + num_node);
+    if (ptr_store.size() != num_tree + 1) ptr_store.assign(tree_ptr, tree_ptr + num_tree + 1);
+    if (group_store.size() != num_tree) group_store.assign(tree_group, tree_group + num_tree);
+  }
+  // map n entries from stream, copy them into store if the stream cannot be mapped
+  template<typename T>
+  inline static const T *ReadArray(utils::IStream &fi, size_t n, std::vector<T> *store) {
+    if (n == 0) return NULL;
+    const void *ptr = fi.MapRead(sizeof(T) * n);
+    if (ptr != NULL && reinterpret_cast<size_t>(ptr) % sizeof(int) == 0) {
+      return static_cast<const T*>(ptr);
+    }
+    store->resize(n);
+    if (ptr != NULL) {
+      memcpy(&(*store)[0], ptr, sizeof(T) * n);
+    } else {
+      utils::Check(fi.Read(&(*store)[0], sizeof(T) * n) != 0, "FlatEnsemble: invalid model file");
+    }
+    return &(*store)[0];
+  }
+  /*! \brief nodes of all the trees, in node_store or in mapped model file */
+  const Node *nodes;
+  /*! \brief start position of each tree in nodes, with an extra end position */
+  const unsigned *tree_ptr;
+  /*! \brief output group of each tree */
+  const int *tree_group;
+  /*! \brief number of nodes */
+  size_t num_node;
+  /*! \brief number of trees */
+  size_t num_tree;
+  /*! \brief storage of the arrays when they are built from trees or copied from stream */
+  std::vector<Node> node_store;
+  std::vector<unsigned> ptr_store;
+  std::vector<int> group_store;
+  /*! \brief index of trees in each output group */
+  std::vector< std::vector<unsigned> > group_trees;
+};
+}  // namespace tree
+}  // namespace xgboost
+#endif  // XGBOOST_TREE_FLAT_ENSEMBLE_H_
@@ -164,6 +164,15 @@ class TreeModel {
   };
 
  protected:
+  /*! \brief node in compact format, the right child is at cleft + 1 */
+  struct CompactNode {
+    // index of left child, -1 if leaf
+    int cleft;
+    // split feature index, highest bit indicates default direction
+    unsigned sindex;
+    // leaf value or split condition
+    typename Node::Info info;
+  };
   // vector of nodes
   std::vector<Node> nodes;
   // stats of nodes
@@ -247,6 +256,10 @@ class TreeModel {
   inline NodeStat &stat(int nid) {
     return stats[nid];
   }
+  /*! \brief get node statistics given nid */
+  inline const NodeStat &stat(int nid) const {
+    return stats[nid];
+  }
   /*! \brief initialize the model */
   inline void InitModel(void) {
     param.num_nodes = param.num_roots;
@@ -290,6 +303,71 @@ class TreeModel {
     fo.Write(&nodes[0], sizeof(Node) * nodes.size());
     fo.Write(&stats[0], sizeof(NodeStat) * nodes.size());
   }
+  /*!
+   * \brief load model saved by SaveModelCompact, node statistics are set to zero
+   * \param fi input stream
+   */
+  inline void LoadModelCompact(utils::IStream &fi) {
+    utils::Check(fi.Read(&param, sizeof(Param)) > 0,
+                 "TreeModel: wrong format");
+    utils::Check(param.num_deleted == 0 && param.num_nodes >= param.num_roots,
+                 "TreeModel: wrong format");
+    std::vector<CompactNode> cnodes(param.num_nodes);
+    utils::Check(fi.Read(&cnodes[0], sizeof(CompactNode) * cnodes.size()) > 0,
+                 "TreeModel: wrong format");
+    nodes.resize(param.num_nodes);
+    stats.clear(); stats.resize(param.num_nodes);
+    deleted_nodes.resize(0);
+    for (int i = 0; i < param.num_roots; ++i) {
+      nodes[i].set_parent(-1);
+    }
+    for (int i = 0; i < param.num_nodes; ++i) {
+      const CompactNode &src = cnodes[i];
+      Node &dst = nodes[i];
+      dst.sindex_ = src.sindex;
+      dst.info_ = src.info;
+      dst.cleft_ = src.cleft;
+      dst.cright_ = src.cleft == -1 ? -1 : src.cleft + 1;
+      if (src.cleft != -1) {
+        utils::Check(src.cleft > i && src.cleft + 1 < param.num_nodes,
+                     "TreeModel: wrong format");
+        nodes[src.cleft].set_parent(i, true);
+        nodes[src.cleft + 1].set_parent(i, false);
+      }
+    }
+  }
+  /*!
+   * \brief save model in compact format used for inference, node statistics and
+   *  deleted nodes are dropped, nodes are renumbered in breadth first order
+   *  so that the right child always follows the left child
+   * \param fo output stream
+   */
+  inline void SaveModelCompact(utils::IStream &fo) const {
+    std::vector<int> qnode;
+    for (int i = 0; i < param.num_roots; ++i) {
+      qnode.push_back(i);
+    }
+    std::vector<CompactNode> cnodes(param.num_roots);
+    for (size_t i = 0; i < qnode.size(); ++i) {
+      const Node &src = nodes[qnode[i]];
+      CompactNode &dst = cnodes[i];
+      dst.info = src.info_;
+      if (src.is_leaf()) {
+        dst.cleft = -1; dst.sindex = 0;
+      } else {
+        dst.cleft = static_cast<int>(qnode.size());
+        dst.sindex = src.sindex_;
+        qnode.push_back(src.cleft());
+        qnode.push_back(src.cright());
+        cnodes.resize(cnodes.size() + 2);
+      }
+    }
+    Param p = param;
+    p.num_nodes = static_cast<int>(cnodes.size());
+    p.num_deleted = 0;
+    fo.Write(&p, sizeof(Param));
+    fo.Write(&cnodes[0], sizeof(CompactNode) * cnodes.size());
+  }
   /*! 
    * \brief add child nodes to node
    * \param nid node id to add childs
@@ -486,6 +564,87 @@ class RegTree: public TreeModel<bst_float, RTreeNodeStat>{
       return data[i].flag == -1;
     }
   };
+  /*!
+   * \brief sparse feature vector, used instead of FVec when number of features is too large
+   *  to keep a dense vector per thread. short rows are kept sorted and binary searched,
+   *  longer rows are put into a small open addressing hash table, it has same interface as FVec
+   */
+  struct SparseFVec {
+    /*! \brief rows with at most kMaxSorted entries use sorted lookup */
+    static const bst_uint kMaxSorted = 32;
+    /*! \brief empty slot of hash table */
+    static const bst_uint kEmpty = ~0U;
+    /*! \brief feature index of entries, sorted array or hash table */
+    std::vector<bst_uint> index;
+    /*! \brief feature value of entries */
+    std::vector<float> value;
+    /*! \brief shift of hash function, 0 means sorted lookup */
+    int hash_shift;
+    SparseFVec(void) : hash_shift(0) {}
+    /*! \brief fill the vector with sparse vector, later entry wins on duplicated index as in FVec */
+    inline void Fill(const SparseBatch::Inst &inst) {
+      if (inst.length <= kMaxSorted) {
+        hash_shift = 0;
+        index.resize(inst.length);
+        value.resize(inst.length);
+        // insertion sort, rows are usually sorted already
+        for (bst_uint i = 0; i < inst.length; ++i) {
+          bst_uint j = i;
+          for (; j != 0 && index[j - 1] > inst[i].findex; --j) {
+            index[j] = index[j - 1]; value[j] = value[j - 1];
+          }
+          index[j] = inst[i].findex; value[j] = inst[i].fvalue;
+        }
+      } else {
+        // table is at most half full
+        int nbit = 1;
+        while ((1U << nbit) < inst.length * 2) ++nbit;
+        hash_shift = 32 - nbit;
+        index.resize(1U << nbit);
+        value.resize(1U << nbit);
+        std::fill(index.begin(), index.end(), kEmpty);
+        for (bst_uint i = 0; i < inst.length; ++i) {
+          bst_uint pos = this->Hash(inst[i].findex);
+          while (index[pos] != kEmpty && index[pos] != inst[i].findex) {
+            pos = (pos + 1) & (static_cast<bst_uint>(index.size()) - 1);
+          }
+          index[pos] = inst[i].findex; value[pos] = inst[i].fvalue;
+        }
+      }
+    }
+    /*! \brief drop the trace after fill, nothing needs to be reset for sparse vector */
+    inline void Drop(const SparseBatch::Inst &inst) {}
+    /*! \brief get ith value, 0 if the value is missing */
+    inline float fvalue(size_t i) const {
+      const float *p = this->Find(static_cast<bst_uint>(i));
+      return p == NULL ? 0.0f : *p;
+    }
+    /*! \brief check whether i-th entry is missing */
+    inline bool is_missing(size_t i) const {
+      return this->Find(static_cast<bst_uint>(i)) == NULL;
+    }
+    /*!
+     * \brief look up feature i once, used by tree traversal instead of fvalue and is_missing
+     * \return pointer to the value of feature i, NULL if the value is missing
+     */
+    inline const float *Find(bst_uint i) const {
+      if (hash_shift == 0) {
+        // last of the equal entries, which is the latest filled one
+        const size_t pos = std::upper_bound(index.begin(), index.end(), i) - index.begin();
+        return (pos != 0 && index[pos - 1] == i) ? &value[pos - 1] : NULL;
+      }
+      const bst_uint mask = static_cast<bst_uint>(index.size()) - 1;
+      for (bst_uint pos = this->Hash(i); index[pos] != kEmpty; pos = (pos + 1) & mask) {
+        if (index[pos] == i) return &value[pos];
+      }
+      return NULL;
+    }
+
+   private:
+    inline bst_uint Hash(bst_uint i) const {
+      return (i * 2654435761U) >> hash_shift;
+    }
+  };
   /*!
    * \brief get the leaf index 
    * \param feats dense feature vector, if the feature is missing the field is set to NaN
@@ -512,6 +671,17 @@ class RegTree: public TreeModel<bst_float, RTreeNodeStat>{
     int pid = this->GetLeafIndex(feat, root_id);
     return (*this)[pid].leaf_value();
   }
+  /*!
+   * \brief generate C statements that return the prediction of the tree,
+   *  the feature values are read from array f, and NaN is treated as missing
+   * \param indent number of spaces to indent the statements
+   */
+  inline std::string GenerateCode(int indent) const {
+    utils::Check(param.num_roots == 1, "GenerateCode: only support tree with single root");
+    std::stringstream fo("");
+    this->GenerateCode(0, fo, indent);
+    return fo.str();
+  }
   /*! \brief get next position of the tree given current pid */
   inline int GetNext(int pid, float fvalue, bool is_unknown) const {
     float split_value = (*this)[pid].split_cond();
@@ -525,6 +695,28 @@ class RegTree: public TreeModel<bst_float, RTreeNodeStat>{
       }
     }
   }
+
+ private:
+  void GenerateCode(int nid, std::stringstream &fo, int indent) const {
+    const std::string space(indent, ' ');
+    const Node &node = (*this)[nid];
+    if (node.is_leaf()) {
+      fo << space << "return " << utils::FloatToCode(node.leaf_value()) << ";\n";
+      return;
+    }
+    const unsigned fid = node.split_index();
+    const std::string cond = utils::FloatToCode(node.split_cond());
+    // NaN fails every comparison, so missing value follows the negated test
+    if (node.default_left()) {
+      fo << space << "if (!(f[" << fid << "] >= " << cond << ")) {\n";
+    } else {
+      fo << space << "if (f[" << fid << "] < " << cond << ") {\n";
+    }
+    this->GenerateCode(node.cleft(), fo, indent + 2);
+    fo << space << "} else {\n";
+    this->GenerateCode(node.cright(), fo, indent + 2);
+    fo << space << "}\n";
+  }
 };
 
 }  // namespace tree
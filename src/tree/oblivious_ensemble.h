@@ -0,0 +1,210 @@
+#ifndef XGBOOST_TREE_OBLIVIOUS_ENSEMBLE_H_
+#define XGBOOST_TREE_OBLIVIOUS_ENSEMBLE_H_
+/*!
+ * \file oblivious_ensemble.h
+ * \brief ensemble of oblivious trees, where all the nodes at a depth share the same split,
+ *   such as the trees grown by updater grow_oblivious. the leaf index of a row is the bitmask
+ *   of the comparisons at each depth, so traversal has no data dependent branch
+ */
+#include <vector>
+#include "./flat_ensemble.h"
+
+#if XGBOOST_FLAT_AVX2
+#include <immintrin.h>
+#endif
+
+namespace xgboost {
+namespace tree {
+/*!
+ * \brief oblivious copy of FlatEnsemble, one split per depth and 2^depth leaves per tree,
+ *  the ensemble is only valid when every tree is a complete oblivious tree
+ */
+class ObliviousEnsemble {
+ public:
+  /*! \brief split shared by all the nodes at one depth */
+  struct Level {
+    /*! \brief split feature index, highest bit indicates whether missing value goes left */
+    unsigned sindex;
+    /*! \brief split condition */
+    float threshold;
+  };
+  /*! \brief dense feature vector, the type selects this engine in prediction */
+  class FVec : public RegTree::FVec {};
+  /*! \brief constructor */
+  ObliviousEnsemble(void) {
+    this->Clear();
+  }
+  /*! \brief clear the ensemble */
+  inline void Clear(void) {
+    num_tree = 0; valid = false;
+    levels.clear(); leaf_value.clear();
+    level_ptr.clear(); level_ptr.push_back(0);
+    leaf_ptr.clear(); leaf_ptr.push_back(0);
+  }
+  /*! \return number of trees in the ensemble */
+  inline size_t NumTree(void) const {
+    return num_tree;
+  }
+  /*! \return whether all the trees given in AddTrees are oblivious */
+  inline bool Valid(void) const {
+    return valid;
+  }
+  /*!
+   * \brief add trees [NumTree(), flat.NumTree()) to the ensemble, every tree must be a complete
+   *  oblivious tree, otherwise the ensemble is marked as not valid until Clear.
+   *  the trees already in the ensemble are not visited again
+   * \param flat the flattened trees, the first NumTree() ones must be those already added
+   * \return whether all the trees are complete oblivious trees
+   */
+  inline bool AddTrees(const FlatEnsemble &flat) {
+    if (flat.NumTree() < num_tree) this->Clear();
+    const size_t begin = num_tree;
+    num_tree = flat.NumTree();
+    if (begin != 0 && !valid) return false;
+    for (size_t tid = begin; tid < num_tree; ++tid) {
+      if (!this->AddTree(flat, tid)) {
+        this->Clear();
+        num_tree = flat.NumTree();
+        return false;
+      }
+    }
+    valid = true;
+    return true;
+  }
+  /*!
+   * \brief predict the value of one tree
+   * \param tid index of tree in the ensemble
+   * \param feat dense feature vector of the row
+   * \param root_id starting root index of the instance, oblivious trees have only one root
+   */
+  template<typename TFVec>
+  inline float PredictTree(size_t tid, const TFVec &feat, unsigned root_id = 0) const {
+    const Level *level = &levels[level_ptr[tid]];
+    const unsigned depth = level_ptr[tid + 1] - level_ptr[tid];
+    unsigned idx = 0;
+    for (unsigned d = 0; d < depth; ++d) {
+      const unsigned fid = level[d].sindex & ((1U << 31) - 1U);
+      const unsigned right = feat.is_missing(fid) ? (level[d].sindex >> 31) ^ 1U :
+          static_cast<unsigned>(!(feat.fvalue(fid) < level[d].threshold));
+      idx = (idx << 1) | right;
+    }
+    return leaf_value[leaf_ptr[tid] + idx];
+  }
+  /*!
+   * \brief predict the value of one tree for FlatEnsemble::kBatchWidth rows together
+   * \param tid index of tree in the ensemble
+   * \param dense row major dense features of the rows, missing value is marked by flag == -1
+   * \param stride number of entries per row in dense
+   * \param out_pred leaf value of each row
+   * \param simd whether to use vectorized kernel, must be checked by FlatEnsemble::SupportSimd
+   */
+  inline void PredictTreeBatch(size_t tid, const RegTree::FVec::Entry *dense, unsigned stride,
+                               float *out_pred, bool simd) const {
+#if XGBOOST_FLAT_AVX2
+    if (simd) {
+      this->PredictTreeAVX2(tid, dense, stride, out_pred); return;
+    }
+#endif
+    const Level *level = &levels[level_ptr[tid]];
+    const unsigned depth = level_ptr[tid + 1] - level_ptr[tid];
+    unsigned idx[FlatEnsemble::kBatchWidth] = {0};
+    for (unsigned d = 0; d < depth; ++d) {
+      const RegTree::FVec::Entry *col = dense + (level[d].sindex & ((1U << 31) - 1U));
+      const unsigned miss_right = (level[d].sindex >> 31) ^ 1U;
+      for (int k = 0; k < FlatEnsemble::kBatchWidth; ++k) {
+        const RegTree::FVec::Entry &e = col[k * stride];
+        const unsigned right = e.flag == -1 ? miss_right :
+            static_cast<unsigned>(!(e.fvalue < level[d].threshold));
+        idx[k] = (idx[k] << 1) | right;
+      }
+    }
+    for (int k = 0; k < FlatEnsemble::kBatchWidth; ++k) {
+      out_pred[k] = leaf_value[leaf_ptr[tid] + idx[k]];
+    }
+  }
+
+ private:
+#if XGBOOST_FLAT_AVX2
+  /*!
+   * \brief vectorized version of PredictTreeBatch, all the lanes test the same feature
+   *  at each depth, so one strided gather and one compare produce the next bit of every lane
+   */
+  __attribute__((target("avx2")))
+  inline void PredictTreeAVX2(size_t tid, const RegTree::FVec::Entry *dense, unsigned stride,
+                              float *out_pred) const {
+    const Level *level = &levels[level_ptr[tid]];
+    const unsigned depth = level_ptr[tid + 1] - level_ptr[tid];
+    const int *pfeat = reinterpret_cast<const int*>(dense);
+    const __m256i kOne = _mm256_set1_epi32(1);
+    const __m256i kNone = _mm256_set1_epi32(-1);
+    const __m256i row_offset =
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                           _mm256_set1_epi32(static_cast<int>(stride)));
+    __m256i idx = _mm256_setzero_si256();
+    for (unsigned d = 0; d < depth; ++d) {
+      const unsigned fid = level[d].sindex & ((1U << 31) - 1U);
+      const __m256i fvalue = _mm256_i32gather_epi32(pfeat + fid, row_offset, 4);
+      const __m256i is_missing = _mm256_cmpeq_epi32(fvalue, kNone);
+      const __m256i is_less = _mm256_castps_si256(
+          _mm256_cmp_ps(_mm256_castsi256_ps(fvalue), _mm256_set1_ps(level[d].threshold),
+                        _CMP_LT_OQ));
+      const __m256i miss_left = _mm256_set1_epi32((level[d].sindex >> 31) != 0 ? -1 : 0);
+      const __m256i go_left = _mm256_blendv_epi8(is_less, miss_left, is_missing);
+      idx = _mm256_add_epi32(_mm256_add_epi32(idx, idx), _mm256_andnot_si256(go_left, kOne));
+    }
+    _mm256_storeu_ps(out_pred, _mm256_i32gather_ps(&leaf_value[leaf_ptr[tid]], idx, 4));
+  }
+#endif
+  /*!
+   * \brief add tree tid of flat, nodes of a complete tree in breadth first order
+   *  have left child 2 * i + 1, which is checked along with the shared splits
+   * \return whether the tree is a complete oblivious tree
+   */
+  inline bool AddTree(const FlatEnsemble &flat, size_t tid) {
+    const size_t begin = flat.TreeBegin(tid);
+    const size_t nnode = flat.TreeBegin(tid + 1) - begin;
+    unsigned depth = 0;
+    for (size_t nid = begin; !flat[nid].is_leaf(); nid = flat[nid].cleft) {
+      if (++depth >= 31) return false;
+    }
+    if (nnode != (static_cast<size_t>(2) << depth) - 1) return false;
+    for (unsigned d = 0; d <= depth; ++d) {
+      const size_t lbegin = (static_cast<size_t>(1) << d) - 1;
+      const size_t lend = (static_cast<size_t>(2) << d) - 1;
+      const FlatEnsemble::Node &first = flat[begin + lbegin];
+      for (size_t i = lbegin; i < lend; ++i) {
+        const FlatEnsemble::Node &n = flat[begin + i];
+        if (d == depth) {
+          if (!n.is_leaf()) return false;
+          leaf_value.push_back(n.value);
+        } else if (n.is_leaf() || static_cast<size_t>(n.cleft) != begin + 2 * i + 1 ||
+                   n.sindex != first.sindex || n.value != first.value) {
+          return false;
+        }
+      }
+      if (d != depth) {
+        Level l;
+        l.sindex = first.sindex; l.threshold = first.value;
+        levels.push_back(l);
+      }
+    }
+    level_ptr.push_back(static_cast<unsigned>(levels.size()));
+    leaf_ptr.push_back(static_cast<unsigned>(leaf_value.size()));
+    return true;
+  }
+  /*! \brief number of trees */
+  size_t num_tree;
+  /*! \brief whether the trees are all oblivious */
+  bool valid;
+  /*! \brief splits of all the trees, one per depth */
+  std::vector<Level> levels;
+  /*! \brief start position of each tree in levels, with an extra end position */
+  std::vector<unsigned> level_ptr;
+  /*! \brief leaf values of all the trees, indexed by the comparison bitmask */
+  std::vector<float> leaf_value;
+  /*! \brief start position of each tree in leaf_value, with an extra end position */
+  std::vector<unsigned> leaf_ptr;
+};
+}  // namespace tree
+}  // namespace xgboost
+#endif  // XGBOOST_TREE_OBLIVIOUS_ENSEMBLE_H_
@@ -69,6 +69,11 @@ struct TrainParam{
   int default_direction;
   // whether we want to do subsample
   float subsample;
+  // gradient based one-side sampling, fraction of rows with largest |grad| to keep,
+  // 0 means uniform subsample is used instead
+  float goss_top_rate;
+  // gradient based one-side sampling, fraction of rows sampled from the rest
+  float goss_other_rate;
   // whether to subsample columns each split, in each level
   float colsample_bylevel;
   // whether to subsample columns during tree construction
@@ -87,6 +92,8 @@ struct TrainParam{
     reg_method = 2;
     default_direction = 0;
     subsample = 1.0f;
+    goss_top_rate = 0.0f;
+    goss_other_rate = 0.1f;
     colsample_bytree = 1.0f;
     colsample_bylevel = 1.0f;
     opt_dense_col = 1.0f;
@@ -108,6 +115,8 @@ struct TrainParam{
     if (!strcmp(name, "reg_lambda")) reg_lambda = static_cast<float>(atof(val));
     if (!strcmp(name, "reg_method")) reg_method = static_cast<float>(atof(val));
     if (!strcmp(name, "subsample")) subsample = static_cast<float>(atof(val));
+    if (!strcmp(name, "goss_top_rate")) goss_top_rate = static_cast<float>(atof(val));
+    if (!strcmp(name, "goss_other_rate")) goss_other_rate = static_cast<float>(atof(val));
     if (!strcmp(name, "colsample_bylevel")) colsample_bylevel = static_cast<float>(atof(val));
     if (!strcmp(name, "colsample_bytree")) colsample_bytree  = static_cast<float>(atof(val));
     if (!strcmp(name, "opt_dense_col")) opt_dense_col = static_cast<float>(atof(val));
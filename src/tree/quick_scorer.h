@@ -0,0 +1,257 @@
+#ifndef XGBOOST_TREE_QUICK_SCORER_H_
+#define XGBOOST_TREE_QUICK_SCORER_H_
+/*!
+ * \file quick_scorer.h
+ * \brief bitvector based evaluator of ensemble of shallow trees,
+ *   the split nodes of all trees are reorganized by feature and sorted by threshold,
+ *   see QuickScorer: Lucchese et.al, SIGIR 2015
+ */
+#include <vector>
+#include <algorithm>
+#include "./model.h"
+
+namespace xgboost {
+namespace tree {
+/*!
+ * \brief quick scorer of an ensemble of trees, each tree can have at most 64 leaves.
+ *  leaves of each tree are numbered from left to right, and every tree keeps a 64 bit
+ *  vector of leaves that are still reachable. a split node whose test goes right
+ *  removes the leaves of its left subtree, the exit leaf is the leftmost remaining one
+ */
+class QuickScorer {
+ public:
+  /*! \brief maximum number of leaves per tree */
+  static const int kMaxLeaf = 64;
+  /*! \brief constructor */
+  QuickScorer(void) {
+    this->Clear();
+  }
+  /*! \brief clear the scorer */
+  inline void Clear(void) {
+    num_tree = 0; valid = false;
+    feat_ptr.clear(); threshold.clear(); node_tree.clear(); node_mask.clear();
+    miss_ptr.clear(); miss_tree.clear(); miss_mask.clear();
+    leaf_ptr.clear(); leaf_value.clear();
+  }
+  /*! \return number of trees in the scorer */
+  inline size_t NumTree(void) const {
+    return num_tree;
+  }
+  /*! \return whether the trees given in AddTrees can be handled by the scorer */
+  inline bool Valid(void) const {
+    return valid;
+  }
+  /*!
+   * \brief add trees [NumTree(), trees.size()) to the scorer, every tree must have single root
+   *  at most kMaxLeaf leaves and split on features below num_feature,
+   *  otherwise the scorer is marked as not valid until Clear.
+   *  the trees already in the scorer are not visited again, their split nodes are merged
+   *  with the split nodes of the new trees
+   * \param trees the trees in the model, the first NumTree() ones must be those already added
+   * \param num_feature number of features
+   * \return whether the scorer is valid
+   */
+  inline bool AddTrees(const std::vector<RegTree*> &trees, int num_feature) {
+    if (trees.size() < num_tree || (num_tree != 0 && valid &&
+                                     feat_ptr.size() != static_cast<size_t>(num_feature) + 1)) {
+      this->Clear();
+    }
+    const size_t begin = num_tree;
+    if (begin != 0 && !valid) {
+      num_tree = trees.size(); return false;
+    }
+    for (size_t i = begin; i < trees.size(); ++i) {
+      if (trees[i]->param.num_roots != 1 || CountLeaf(*trees[i], 0) > kMaxLeaf) {
+        this->Clear();
+        num_tree = trees.size();
+        return false;
+      }
+    }
+    if (begin == 0) {
+      leaf_ptr.push_back(0);
+      feat_ptr.resize(num_feature + 1, 0);
+      miss_ptr.resize(num_feature + 1, 0);
+    }
+    std::vector<SplitEntry> splits;
+    for (size_t i = begin; i < trees.size(); ++i) {
+      AddNode(*trees[i], 0, static_cast<unsigned>(i), &splits);
+      leaf_ptr.push_back(static_cast<unsigned>(leaf_value.size()));
+    }
+    std::sort(splits.begin(), splits.end(), SplitEntry::Cmp);
+    // splits on features beyond num_feature are left to tree traversal
+    for (size_t i = 0; i < splits.size(); ++i) {
+      if (splits[i].fid >= static_cast<unsigned>(num_feature)) {
+        this->Clear();
+        num_tree = trees.size();
+        return false;
+      }
+    }
+    this->MergeSplits(splits, num_feature);
+    num_tree = trees.size();
+    valid = true;
+    return true;
+  }
+  /*!
+   * \brief compute the leaf bitvectors of all trees for one instance
+   * \param feat feature vector, every feature is visited
+   * \param leaves output bitvector of each tree, must have NumTree() entries
+   */
+  template<typename TFVec>
+  inline void Predict(const TFVec &feat, uint64_t *leaves) const {
+    std::fill(leaves, leaves + num_tree, ~static_cast<uint64_t>(0));
+    const size_t nfeat = feat_ptr.size() - 1;
+    for (size_t fid = 0; fid < nfeat; ++fid) {
+      if (feat.is_missing(fid)) {
+        // missing value goes to the default direction
+        for (unsigned i = miss_ptr[fid]; i < miss_ptr[fid + 1]; ++i) {
+          leaves[miss_tree[i]] &= miss_mask[i];
+        }
+      } else {
+        // nodes with threshold no larger than fvalue go right, NaN goes right on all nodes
+        const float fvalue = feat.fvalue(fid);
+        for (unsigned i = feat_ptr[fid]; i < feat_ptr[fid + 1] && !(fvalue < threshold[i]); ++i) {
+          leaves[node_tree[i]] &= node_mask[i];
+        }
+      }
+    }
+  }
+  /*!
+   * \brief get the leaf value of tree given its leaf bitvector
+   * \param tid index of the tree
+   * \param leaves bitvector of the tree computed by Predict
+   */
+  inline float LeafValue(size_t tid, uint64_t leaves) const {
+    return leaf_value[leaf_ptr[tid] + LowestBit(leaves)];
+  }
+
+ private:
+  /*! \brief split node collected from the trees */
+  struct SplitEntry {
+    unsigned fid;
+    float thres;
+    unsigned tid;
+    bool default_left;
+    uint64_t mask;
+    inline static bool Cmp(const SplitEntry &a, const SplitEntry &b) {
+      if (a.fid != b.fid) return a.fid < b.fid;
+      return a.thres < b.thres;
+    }
+  };
+  /*! \brief index of the lowest set bit */
+  inline static int LowestBit(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int i = 0;
+    while ((x & 1) == 0) {
+      x >>= 1; ++i;
+    }
+    return i;
+#endif
+  }
+  /*!
+   * \brief merge split nodes sorted by SplitEntry::Cmp into the nodes of each feature,
+   *  the nodes already in the scorer are copied once, in order
+   */
+  inline void MergeSplits(const std::vector<SplitEntry> &splits, int num_feature) {
+    std::vector<float> new_threshold;
+    std::vector<unsigned> new_node_tree, new_miss_tree;
+    std::vector<uint64_t> new_node_mask, new_miss_mask;
+    new_threshold.reserve(threshold.size() + splits.size());
+    new_node_tree.reserve(threshold.size() + splits.size());
+    new_node_mask.reserve(threshold.size() + splits.size());
+    std::vector<unsigned> new_feat_ptr(1, 0), new_miss_ptr(1, 0);
+    size_t j = 0;
+    for (int fid = 0; fid < num_feature; ++fid) {
+      unsigned i = feat_ptr[fid];
+      while (true) {
+        const bool has_old = i < feat_ptr[fid + 1];
+        const bool has_new = j < splits.size() && splits[j].fid == static_cast<unsigned>(fid);
+        if (!has_old && !has_new) break;
+        if (has_old && !(has_new && splits[j].thres < threshold[i])) {
+          new_threshold.push_back(threshold[i]);
+          new_node_tree.push_back(node_tree[i]);
+          new_node_mask.push_back(node_mask[i]);
+          ++i;
+        } else {
+          new_threshold.push_back(splits[j].thres);
+          new_node_tree.push_back(splits[j].tid);
+          new_node_mask.push_back(splits[j].mask);
+          if (!splits[j].default_left) {
+            new_miss_tree.push_back(splits[j].tid);
+            new_miss_mask.push_back(splits[j].mask);
+          }
+          ++j;
+        }
+      }
+      // order of nodes whose missing value goes right does not matter
+      for (unsigned k = miss_ptr[fid]; k < miss_ptr[fid + 1]; ++k) {
+        new_miss_tree.push_back(miss_tree[k]);
+        new_miss_mask.push_back(miss_mask[k]);
+      }
+      new_feat_ptr.push_back(static_cast<unsigned>(new_threshold.size()));
+      new_miss_ptr.push_back(static_cast<unsigned>(new_miss_tree.size()));
+    }
+    threshold.swap(new_threshold);
+    node_tree.swap(new_node_tree);
+    node_mask.swap(new_node_mask);
+    miss_tree.swap(new_miss_tree);
+    miss_mask.swap(new_miss_mask);
+    feat_ptr.swap(new_feat_ptr);
+    miss_ptr.swap(new_miss_ptr);
+  }
+  /*! \brief count leaves of subtree rooted at nid */
+  inline static int CountLeaf(const RegTree &tree, int nid) {
+    if (tree[nid].is_leaf()) return 1;
+    return CountLeaf(tree, tree[nid].cleft()) + CountLeaf(tree, tree[nid].cright());
+  }
+  /*! \brief add leaves of subtree rooted at nid in left to right order, collect the splits */
+  inline void AddNode(const RegTree &tree, int nid, unsigned tid,
+                      std::vector<SplitEntry> *splits) {
+    const RegTree::Node &node = tree[nid];
+    if (node.is_leaf()) {
+      leaf_value.push_back(node.leaf_value()); return;
+    }
+    const int lbegin = static_cast<int>(leaf_value.size()) - static_cast<int>(leaf_ptr.back());
+    this->AddNode(tree, node.cleft(), tid, splits);
+    const int lend = static_cast<int>(leaf_value.size()) - static_cast<int>(leaf_ptr.back());
+    this->AddNode(tree, node.cright(), tid, splits);
+    // going right removes leaves [lbegin, lend) of left subtree
+    uint64_t left = 0;
+    for (int i = lbegin; i < lend; ++i) {
+      left |= static_cast<uint64_t>(1) << i;
+    }
+    SplitEntry e;
+    e.fid = node.split_index();
+    e.thres = node.split_cond();
+    e.tid = tid;
+    e.default_left = node.default_left();
+    e.mask = ~left;
+    splits->push_back(e);
+  }
+  /*! \brief number of trees */
+  size_t num_tree;
+  /*! \brief whether the trees can be handled */
+  bool valid;
+  /*! \brief start position of split nodes of each feature */
+  std::vector<unsigned> feat_ptr;
+  /*! \brief threshold of split nodes, sorted within each feature */
+  std::vector<float> threshold;
+  /*! \brief tree index of split nodes */
+  std::vector<unsigned> node_tree;
+  /*! \brief mask applied when the split goes right */
+  std::vector<uint64_t> node_mask;
+  /*! \brief start position of split nodes of each feature whose missing value goes right */
+  std::vector<unsigned> miss_ptr;
+  /*! \brief tree index of split nodes whose missing value goes right */
+  std::vector<unsigned> miss_tree;
+  /*! \brief mask of split nodes whose missing value goes right */
+  std::vector<uint64_t> miss_mask;
+  /*! \brief start position of leaves of each tree */
+  std::vector<unsigned> leaf_ptr;
+  /*! \brief leaf values in left to right order */
+  std::vector<float> leaf_value;
+};
+}  // namespace tree
+}  // namespace xgboost
+#endif  // XGBOOST_TREE_QUICK_SCORER_H_
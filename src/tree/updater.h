@@ -49,6 +49,7 @@ class IUpdater {
 #include "./updater_prune-inl.hpp"
 #include "./updater_refresh-inl.hpp"
 #include "./updater_colmaker-inl.hpp"
+#include "./updater_oblivious-inl.hpp"
 
 namespace xgboost {
 namespace tree {
@@ -62,6 +63,7 @@ inline IUpdater<FMatrix>* CreateUpdater(const char *name) {
   if (!strcmp(name, "prune")) return new TreePruner<FMatrix>();
   if (!strcmp(name, "refresh")) return new TreeRefresher<FMatrix>();
   if (!strcmp(name, "grow_colmaker")) return new ColMaker<FMatrix, GradStats>();
+  if (!strcmp(name, "grow_oblivious")) return new ObliviousMaker<FMatrix, GradStats>();
   utils::Error("unknown updater:%s", name);
   return NULL;
 }
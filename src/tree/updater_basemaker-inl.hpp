@@ -0,0 +1,235 @@
+#ifndef XGBOOST_TREE_UPDATER_BASEMAKER_INL_HPP_
+#define XGBOOST_TREE_UPDATER_BASEMAKER_INL_HPP_
+/*!
+ * \file updater_basemaker-inl.hpp
+ * \brief base of the builders that grow a tree level by level using column access,
+ *   keeps the position and sampling of rows, the features in use and the node statistics
+ */
+#include <vector>
+#include <algorithm>
+#include "./param.h"
+#include "./updater.h"
+#include "../utils/omp.h"
+#include "../utils/random.h"
+
+namespace xgboost {
+namespace tree {
+/*!
+ * \brief data and steps shared by the builders of ColMaker and ObliviousMaker,
+ *  a builder grows one tree and derives from this class
+ */
+template<typename FMatrix, typename TStats>
+class BaseMaker {
+ public:
+  /*! \brief statistics of a tree node */
+  struct NodeEntry {
+    /*! \brief statics for node entry */
+    TStats stats;
+    /*! \brief loss of this node, without split */
+    bst_float root_gain;
+    /*! \brief weight calculated related to current data */
+    float weight;
+    /*! \brief current best solution */
+    SplitEntry best;
+    // constructor
+    NodeEntry(void) : root_gain(0.0f), weight(0.0f) {
+      stats.Clear();
+    }
+  };
+  // constructor
+  explicit BaseMaker(const TrainParam &param) : param(param) {}
+
+ protected:
+  /*!
+   * \brief initialize position and sampling of rows, the feature set, and the roots to be expanded
+   * \return the gradient to be used in tree construction, rescaled if one-side sampling is used
+   */
+  inline const std::vector<bst_gpair> &InitData(const std::vector<bst_gpair> &gpair,
+                                                const FMatrix &fmat,
+                                                const std::vector<unsigned> &root_index,
+                                                const RegTree &tree) {
+    utils::Assert(tree.param.num_nodes == tree.param.num_roots, "can only grow new tree");
+    const std::vector<bst_uint> &rowset = fmat.buffered_rowset();
+    {// setup position
+      position.resize(gpair.size());
+      if (root_index.size() == 0) {
+        for (size_t i = 0; i < rowset.size(); ++i) {
+          position[rowset[i]] = 0;
+        }
+      } else {
+        for (size_t i = 0; i < rowset.size(); ++i) {
+          const bst_uint ridx = rowset[i];
+          position[ridx] = root_index[ridx];
+          utils::Assert(root_index[ridx] < (unsigned)tree.param.num_roots,
+                        "root index exceed setting");
+        }
+      }
+      // mark delete for the deleted datas
+      for (size_t i = 0; i < rowset.size(); ++i) {
+        const bst_uint ridx = rowset[i];
+        if (gpair[ridx].hess < 0.0f) position[ridx] = -1;
+      }
+      // mark subsample
+      utils::Check(param.goss_top_rate >= 0.0f && param.goss_top_rate <= 1.0f,
+                   "goss_top_rate must be in [0, 1]");
+      utils::Check(param.goss_other_rate >= 0.0f && param.goss_other_rate <= 1.0f,
+                   "goss_other_rate must be in [0, 1]");
+      utils::Check(param.goss_top_rate + param.goss_other_rate <= 1.0f,
+                   "goss_top_rate + goss_other_rate must not exceed 1");
+      if (param.goss_top_rate > 0.0f) {
+        this->SampleOneSide(gpair, rowset);
+      } else if (param.subsample < 1.0f) {
+        for (size_t i = 0; i < rowset.size(); ++i) {
+          const bst_uint ridx = rowset[i];
+          if (gpair[ridx].hess < 0.0f) continue;
+          if (random::SampleBinary(param.subsample) == 0) position[ridx] = -1;
+        }
+      }
+      // only keep the sampled rows, so that row scans skip the rest
+      sampled_rowset.clear();
+      for (size_t i = 0; i < rowset.size(); ++i) {
+        if (position[rowset[i]] >= 0) sampled_rowset.push_back(rowset[i]);
+      }
+    }
+    {
+      // initialize feature index
+      unsigned ncol = static_cast<unsigned>(fmat.NumCol());
+      for (unsigned i = 0; i < ncol; ++i) {
+        if (fmat.GetColSize(i) != 0) {
+          feat_index.push_back(i);
+        }
+      }
+      unsigned n = static_cast<unsigned>(param.colsample_bytree * feat_index.size());
+      random::Shuffle(feat_index);
+      utils::Check(n > 0, "colsample_bytree is too small that no feature can be included");
+      feat_index.resize(n);
+    }
+    {// setup temp space for each thread
+      #pragma omp parallel
+      {
+        this->nthread = omp_get_num_threads();
+      }
+      sstats.clear();
+      sstats.resize(this->nthread, std::vector<TStats>());
+      snode.reserve(256);
+    }
+    {// expand query
+      qexpand.reserve(256); qexpand.clear();
+      for (int i = 0; i < tree.param.num_roots; ++i) {
+        qexpand.push_back(i);
+      }
+    }
+    return param.goss_top_rate > 0.0f ? sampled_gpair : gpair;
+  }
+  /*!
+   * \brief gradient based one-side sampling, keep the rows with largest |grad|,
+   *  randomly sample the rest and scale up their statistics to keep the sum unbiased,
+   *  the rescaled gradient is stored in sampled_gpair, only for the rows that are kept
+   */
+  inline void SampleOneSide(const std::vector<bst_gpair> &gpair,
+                            const std::vector<bst_uint> &rowset) {
+    std::vector<bst_uint> rows;
+    for (size_t i = 0; i < rowset.size(); ++i) {
+      if (position[rowset[i]] >= 0) rows.push_back(rowset[i]);
+    }
+    sampled_gpair.resize(gpair.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+      sampled_gpair[rows[i]] = gpair[rows[i]];
+    }
+    const size_t ntop = static_cast<size_t>(param.goss_top_rate * rows.size());
+    const float prob = param.goss_other_rate / (1.0f - param.goss_top_rate);
+    if (ntop >= rows.size() || prob >= 1.0f) return;
+    std::nth_element(rows.begin(), rows.begin() + ntop, rows.end(), CmpAbsGrad(gpair));
+    const float scale = 1.0f / prob;
+    for (size_t i = ntop; i < rows.size(); ++i) {
+      const bst_uint ridx = rows[i];
+      if (random::SampleBinary(prob) == 0) {
+        position[ridx] = -1;
+      } else {
+        sampled_gpair[ridx].grad *= scale;
+        sampled_gpair[ridx].hess *= scale;
+      }
+    }
+  }
+  // larger absolute gradient goes first
+  struct CmpAbsGrad {
+    const std::vector<bst_gpair> &gpair;
+    explicit CmpAbsGrad(const std::vector<bst_gpair> &gpair) : gpair(gpair) {}
+    inline bool operator()(bst_uint a, bst_uint b) const {
+      return fabsf(gpair[a].grad) > fabsf(gpair[b].grad);
+    }
+  };
+  /*! \brief initialize the base_weight, root_gain, and NodeEntry of the new nodes in qexpand */
+  inline void InitNewNode(const std::vector<int> &qexpand,
+                          const std::vector<bst_gpair> &gpair,
+                          const RegTree &tree) {
+    {// setup statistics space for each tree node
+      for (size_t i = 0; i < sstats.size(); ++i) {
+        sstats[i].resize(tree.param.num_nodes);
+      }
+      snode.resize(tree.param.num_nodes, NodeEntry());
+    }
+    for (size_t tid = 0; tid < sstats.size(); ++tid) {
+      for (size_t j = 0; j < qexpand.size(); ++j) {
+        sstats[tid][qexpand[j]].Clear();
+      }
+    }
+    const std::vector<bst_uint> &rowset = sampled_rowset;
+    // setup position
+    const unsigned ndata = static_cast<unsigned>(rowset.size());
+    #pragma omp parallel for schedule(static)
+    for (unsigned i = 0; i < ndata; ++i) {
+      const bst_uint ridx = rowset[i];
+      const int tid = omp_get_thread_num();
+      if (position[ridx] < 0) continue;
+      sstats[tid][position[ridx]].Add(gpair[ridx]);
+    }
+    // sum the per thread statistics together
+    for (size_t j = 0; j < qexpand.size(); ++j) {
+      const int nid = qexpand[j];
+      TStats stats; stats.Clear();
+      for (size_t tid = 0; tid < sstats.size(); ++tid) {
+        stats.Add(sstats[tid][nid]);
+      }
+      // update node statistics
+      snode[nid].stats = stats;
+      snode[nid].root_gain = param.CalcGain(stats);
+      snode[nid].weight = param.CalcWeight(stats);
+    }
+  }
+  /*! \brief update queue expand add in new leaves */
+  inline void UpdateQueueExpand(const RegTree &tree, std::vector<int> *p_qexpand) {
+    std::vector<int> &qexpand = *p_qexpand;
+    std::vector<int> newnodes;
+    for (size_t i = 0; i < qexpand.size(); ++i) {
+      const int nid = qexpand[i];
+      if (!tree[ nid ].is_leaf()) {
+        newnodes.push_back(tree[nid].cleft());
+        newnodes.push_back(tree[nid].cright());
+      }
+    }
+    // use new nodes for qexpand
+    qexpand = newnodes;
+  }
+  //--data fields--
+  const TrainParam &param;
+  // number of omp thread used during training
+  int nthread;
+  // Per feature: shuffle index of each feature index
+  std::vector<unsigned> feat_index;
+  // Instance Data: current node position in the tree of each instance
+  std::vector<int> position;
+  // Instance Data: rows that are sampled to grow current tree
+  std::vector<bst_uint> sampled_rowset;
+  // Instance Data: rescaled gradient of each instance, used by one-side sampling
+  std::vector<bst_gpair> sampled_gpair;
+  // PerThread x PerTreeNode: statistics of the rows of each new node, summed by InitNewNode
+  std::vector< std::vector<TStats> > sstats;
+  /*! \brief TreeNode Data: statistics for each constructed node */
+  std::vector<NodeEntry> snode;
+  /*! \brief queue of nodes to be expanded */
+  std::vector<int> qexpand;
+};
+}  // namespace tree
+}  // namespace xgboost
+#endif  // XGBOOST_TREE_UPDATER_BASEMAKER_INL_HPP_
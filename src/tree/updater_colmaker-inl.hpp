@@ -9,6 +9,7 @@
 #include <algorithm>
 #include "./param.h"
 #include "./updater.h"
+#include "./updater_basemaker-inl.hpp"
 #include "../utils/omp.h"
 #include "../utils/random.h"
 
@@ -48,6 +49,8 @@ class ColMaker: public IUpdater<FMatrix> {
     TStats stats;
     /*! \brief last feature value scanned */
     float  last_fvalue;
+    /*! \brief index of the run of equal feature values last scanned */
+    unsigned last_run;
     /*! \brief current best solution */
     SplitEntry best;
     // constructor
@@ -55,38 +58,33 @@ class ColMaker: public IUpdater<FMatrix> {
       stats.Clear();
     }
   };
-  struct NodeEntry {
-    /*! \brief statics for node entry */
-    TStats stats;
-    /*! \brief loss of this node, without split */
-    bst_float root_gain;
-    /*! \brief weight calculated related to current data */
-    float weight;
-    /*! \brief current best solution */
-    SplitEntry best;
-    // constructor
-    NodeEntry(void) : root_gain(0.0f), weight(0.0f){
-      stats.Clear();
-    }
-  };
   // actual builder that runs the algorithm
-  struct Builder{
+  struct Builder : public BaseMaker<FMatrix, TStats> {
    public:
+    typedef BaseMaker<FMatrix, TStats> Base;
+    using Base::param;
+    using Base::feat_index;
+    using Base::position;
+    using Base::sampled_rowset;
+    using Base::snode;
+    using Base::qexpand;
     // constructor
-    explicit Builder(const TrainParam &param) : param(param) {}
+    explicit Builder(const TrainParam &param) : Base(param) {}
     // update one tree, growing
-    virtual void Update(const std::vector<bst_gpair> &gpair,
+    virtual void Update(const std::vector<bst_gpair> &in_gpair,
                         const FMatrix &fmat,
                         const BoosterInfo &info,
                         RegTree *p_tree) {
-      this->InitData(gpair, fmat, info.root_index, *p_tree);
-      this->InitNewNode(qexpand, gpair, fmat, *p_tree);
+      // gradient used to grow the tree, it is rescaled when one-side sampling is used
+      const std::vector<bst_gpair> &gpair =
+          this->InitData(in_gpair, fmat, info.root_index, *p_tree);
+      this->InitNewNode(qexpand, gpair, *p_tree);
 
       for (int depth = 0; depth < param.max_depth; ++depth) {
         this->FindSplit(depth, this->qexpand, gpair, fmat, p_tree);
         this->ResetPosition(this->qexpand, fmat, *p_tree);
         this->UpdateQueueExpand(*p_tree, &this->qexpand);
-        this->InitNewNode(qexpand, gpair, fmat, *p_tree);
+        this->InitNewNode(qexpand, gpair, *p_tree);
         // if nothing left to be expand, break
         if (qexpand.size() == 0) break;
       }
@@ -104,168 +102,181 @@ class ColMaker: public IUpdater<FMatrix> {
     }
 
    private:
-    // initialize temp data structure
-    inline void InitData(const std::vector<bst_gpair> &gpair,
-                         const FMatrix &fmat,
-                         const std::vector<unsigned> &root_index, const RegTree &tree) {
-      utils::Assert(tree.param.num_nodes == tree.param.num_roots, "ColMaker: can only grow new tree");
-      const std::vector<bst_uint> &rowset = fmat.buffered_rowset();
-      {// setup position
-        position.resize(gpair.size());
-        if (root_index.size() == 0) {
-          for (size_t i = 0; i < rowset.size(); ++i) {
-            position[rowset[i]] = 0;
-          }
-        } else {
-          for (size_t i = 0; i < rowset.size(); ++i) {
-            const bst_uint ridx = rowset[i];
-            position[ridx] = root_index[ridx];
-            utils::Assert(root_index[ridx] < (unsigned)tree.param.num_roots, "root index exceed setting");
-          }
-        }
-        // mark delete for the deleted datas
-        for (size_t i = 0; i < rowset.size(); ++i) {
-          const bst_uint ridx = rowset[i];
-          if (gpair[ridx].hess < 0.0f) position[ridx] = -1;
-        }
-        // mark subsample
-        if (param.subsample < 1.0f) {
-          for (size_t i = 0; i < rowset.size(); ++i) {
-            const bst_uint ridx = rowset[i];
-            if (gpair[ridx].hess < 0.0f) continue;
-            if (random::SampleBinary(param.subsample) == 0) position[ridx] = -1;
-          }
-        }
-      }
-    
-      {
-        // initialize feature index
-        unsigned ncol = static_cast<unsigned>(fmat.NumCol());
-        for (unsigned i = 0; i < ncol; ++i) {
-          if (fmat.GetColSize(i) != 0) {
-            feat_index.push_back(i);
-          }
-        }
-        unsigned n = static_cast<unsigned>(param.colsample_bytree * feat_index.size());
-        random::Shuffle(feat_index);
-        utils::Check(n > 0, "colsample_bytree is too small that no feature can be included");
-        feat_index.resize(n);
-      }
-      {// setup temp space for each thread
-        #pragma omp parallel
-        {
-          this->nthread = omp_get_num_threads();
-        }
-        // reserve a small space
+    // initialize temp data structure, return the gradient to be used in tree construction
+    inline const std::vector<bst_gpair> &InitData(const std::vector<bst_gpair> &gpair,
+                                                  const FMatrix &fmat,
+                                                  const std::vector<unsigned> &root_index,
+                                                  const RegTree &tree) {
+      const std::vector<bst_gpair> &ret = Base::InitData(gpair, fmat, root_index, tree);
+      {// reserve a small space
         stemp.clear();
         stemp.resize(this->nthread, std::vector<ThreadEntry>());
         for (size_t i = 0; i < stemp.size(); ++i) {
           stemp[i].clear(); stemp[i].reserve(256);
         }
-        snode.reserve(256);
+        stouched.resize(this->nthread, std::vector<int>());
       }
-      {// expand query
-        qexpand.reserve(256); qexpand.clear();
-        for (int i = 0; i < tree.param.num_roots; ++i) {
-          qexpand.push_back(i);
-        }
+      // when sampling drops most of the rows, the column scans of each level
+      // go through a copy of the selected columns that only keeps the sampled rows
+      scol_ptr.clear();
+      if (sampled_rowset.size() * 2 <= fmat.buffered_rowset().size()) {
+        this->InitSampledCol(fmat);
       }
+      return ret;
     }
-    /*! \brief initialize the base_weight, root_gain, and NodeEntry for all the new nodes in qexpand */
-    inline void InitNewNode(const std::vector<int> &qexpand,
-                            const std::vector<bst_gpair> &gpair,
-                            const FMatrix &fmat,
-                            const RegTree &tree) {
-      {// setup statistics space for each tree node
-        for (size_t i = 0; i < stemp.size(); ++i) {
-          stemp[i].resize(tree.param.num_nodes, ThreadEntry());
+    // copy the entries of the sampled rows in the selected columns to scol_data
+    inline void InitSampledCol(const FMatrix &fmat) {
+      scol_ptr.resize(fmat.NumCol() + 1, 0);
+      const unsigned nfeat = static_cast<unsigned>(feat_index.size());
+      #pragma omp parallel for schedule(dynamic, 1)
+      for (unsigned i = 0; i < nfeat; ++i) {
+        const unsigned fid = feat_index[i];
+        size_t n = 0;
+        for (typename FMatrix::ColIter it = fmat.GetSortedCol(fid); it.Next();) {
+          if (position[it.rindex()] >= 0) ++n;
         }
-        snode.resize(tree.param.num_nodes, NodeEntry());
+        scol_ptr[fid + 1] = n;
       }
-      const std::vector<bst_uint> &rowset = fmat.buffered_rowset();
-      // setup position
-      const unsigned ndata = static_cast<unsigned>(rowset.size());
-      #pragma omp parallel for schedule(static)
-      for (unsigned i = 0; i < ndata; ++i) {
-        const bst_uint ridx = rowset[i];
-        const int tid = omp_get_thread_num();
-        if (position[ridx] < 0) continue;
-        stemp[tid][position[ridx]].stats.Add(gpair[ridx]);
+      for (size_t i = 1; i < scol_ptr.size(); ++i) {
+        scol_ptr[i] += scol_ptr[i - 1];
       }
-      // sum the per thread statistics together
-      for (size_t j = 0; j < qexpand.size(); ++j) {
-        const int nid = qexpand[j];
-        TStats stats; stats.Clear();
-        for (size_t tid = 0; tid < stemp.size(); ++tid) {
-          stats.Add(stemp[tid][nid].stats);
+      scol_data.resize(scol_ptr.back());
+      #pragma omp parallel for schedule(dynamic, 1)
+      for (unsigned i = 0; i < nfeat; ++i) {
+        const unsigned fid = feat_index[i];
+        size_t top = scol_ptr[fid];
+        for (typename FMatrix::ColIter it = fmat.GetSortedCol(fid); it.Next();) {
+          if (position[it.rindex()] >= 0) {
+            scol_data[top++] = SparseBatch::Entry(it.rindex(), it.fvalue());
+          }
         }
-        // update node statistics
-        snode[nid].stats = stats;
-        snode[nid].root_gain = param.CalcGain(stats);
-        snode[nid].weight = param.CalcWeight(stats);
       }
     }
-    /*! \brief update queue expand add in new leaves */
-    inline void UpdateQueueExpand(const RegTree &tree, std::vector<int> *p_qexpand) {
-      std::vector<int> &qexpand = *p_qexpand;
-      std::vector<int> newnodes;
-      for (size_t i = 0; i < qexpand.size(); ++i) {
-        const int nid = qexpand[i];
-        if (!tree[ nid ].is_leaf()) {
-          newnodes.push_back(tree[nid].cleft());
-          newnodes.push_back(tree[nid].cright());
-        }
+    // sorted column used in the scans, only has the sampled rows if scol_data is built
+    inline typename FMatrix::ColIter GetSortedCol(const FMatrix &fmat, unsigned fid) const {
+      if (scol_ptr.size() == 0) return fmat.GetSortedCol(fid);
+      const SparseBatch::Entry *base = scol_data.size() == 0 ? NULL : &scol_data[0];
+      return typename FMatrix::ColIter(base + scol_ptr[fid] - 1, base + scol_ptr[fid + 1] - 1);
+    }
+    inline typename FMatrix::ColBackIter GetReverseSortedCol(const FMatrix &fmat,
+                                                             unsigned fid) const {
+      if (scol_ptr.size() == 0) return fmat.GetReverseSortedCol(fid);
+      const SparseBatch::Entry *base = scol_data.size() == 0 ? NULL : &scol_data[0];
+      return typename FMatrix::ColBackIter(base + scol_ptr[fid + 1], base + scol_ptr[fid]);
+    }
+    // initialize the new nodes in qexpand, and setup statistics space of them for each thread
+    inline void InitNewNode(const std::vector<int> &qexpand,
+                            const std::vector<bst_gpair> &gpair,
+                            const RegTree &tree) {
+      for (size_t i = 0; i < stemp.size(); ++i) {
+        stemp[i].resize(tree.param.num_nodes, ThreadEntry());
       }
-      // use new nodes for qexpand
-      qexpand = newnodes;
+      Base::InitNewNode(qexpand, gpair, tree);
     }
     // enumerate the split values of specific feature
+    // statistics of nodes in temp must be cleared, they are cleared again after the enumeration
     template<typename Iter>
     inline void EnumerateSplit(Iter it, unsigned fid,
                                const std::vector<bst_gpair> &gpair,
                                std::vector<ThreadEntry> &temp,
+                               std::vector<int> *p_touched,
                                bool is_forward_search) {
-      // clear all the temp statistics
-      for (size_t j = 0; j < qexpand.size(); ++j) {
-        temp[qexpand[j]].stats.Clear();
-      }
-      while (it.Next()) {
-        const bst_uint ridx = it.rindex();
-        const int nid = position[ridx];
-        if (nid < 0) continue;
-        // start working
-        const float fvalue = it.fvalue();
-        // get the statistics of nid
-        ThreadEntry &e = temp[nid];
-        // test if first hit, this is fine, because we set 0 during init
-        if (e.stats.Empty()) {
-          e.stats.Add(gpair[ridx]);
-          e.last_fvalue = fvalue;
-        } else {
-          // try to find a split
-          if (fabsf(fvalue - e.last_fvalue) > rt_2eps && e.stats.sum_hess >= param.min_child_weight) {
-            TStats c = snode[nid].stats.Substract(e.stats);
-            if (c.sum_hess >= param.min_child_weight) {
-              double loss_chg = param.CalcGain(e.stats) + param.CalcGain(c) - snode[nid].root_gain;
-              e.best.Update(loss_chg, fid, (fvalue + e.last_fvalue) * 0.5f, !is_forward_search);
+      // nodes that are visited in this column, sparse column only visits a few of them
+      std::vector<int> &touched = *p_touched;
+      touched.clear();
+      // the entries are processed in blocks, the random accesses of position and gpair
+      // of a block are issued before they are used, to hide the memory latency
+      const int kBuffer = 32;
+      bst_uint buf_ridx[kBuffer];
+      float buf_fvalue[kBuffer];
+      int buf_nid[kBuffer];
+      unsigned buf_run[kBuffer];
+      // index of current run of equal feature values, entries in the same run
+      // do not need to compare feature value against the last one of the node
+      unsigned run = 0;
+      int nbuf = kBuffer;
+      while (nbuf == kBuffer) {
+        for (nbuf = 0; nbuf < kBuffer && it.Next(); ++nbuf) {
+          if (it.run_begin()) ++run;
+          buf_run[nbuf] = run;
+          buf_ridx[nbuf] = it.rindex();
+          buf_fvalue[nbuf] = it.fvalue();
+          utils::Prefetch(&position[buf_ridx[nbuf]]);
+        }
+        for (int k = 0; k < nbuf; ++k) {
+          buf_nid[k] = position[buf_ridx[k]];
+          if (buf_nid[k] >= 0) utils::Prefetch(&gpair[buf_ridx[k]]);
+        }
+        for (int k = 0; k < nbuf; ++k) {
+          const int nid = buf_nid[k];
+          if (nid < 0) continue;
+          // start working
+          const float fvalue = buf_fvalue[k];
+          const bst_gpair &p = gpair[buf_ridx[k]];
+          // get the statistics of nid
+          ThreadEntry &e = temp[nid];
+          // test if first hit, this is fine, because we set 0 during init
+          if (e.stats.Empty()) {
+            touched.push_back(nid);
+            e.stats.Add(p);
+            e.last_fvalue = fvalue;
+            e.last_run = buf_run[k];
+          } else {
+            // try to find a split
+            if (e.last_run != buf_run[k] &&
+                fabsf(fvalue - e.last_fvalue) > rt_2eps &&
+                e.stats.sum_hess >= param.min_child_weight) {
+              TStats c = snode[nid].stats.Substract(e.stats);
+              if (c.sum_hess >= param.min_child_weight) {
+                double loss_chg = param.CalcGain(e.stats) +
+                    param.CalcGain(c) - snode[nid].root_gain;
+                e.best.Update(loss_chg, fid, (fvalue + e.last_fvalue) * 0.5f, !is_forward_search);
+              }
             }
+            // update the statistics
+            e.stats.Add(p);
+            e.last_fvalue = fvalue;
+            e.last_run = buf_run[k];
           }
-          // update the statistics
-          e.stats.Add(gpair[ridx]);
-          e.last_fvalue = fvalue;
         }
       }
       // finish updating all statistics, check if it is possible to include all sum statistics
-      for (size_t i = 0; i < qexpand.size(); ++i) {
-        const int nid = qexpand[i];
+      for (size_t i = 0; i < touched.size(); ++i) {
+        const int nid = touched[i];
         ThreadEntry &e = temp[nid];
         TStats c = snode[nid].stats.Substract(e.stats);
         if (e.stats.sum_hess >= param.min_child_weight && c.sum_hess >= param.min_child_weight) {
-          const double loss_chg = param.CalcGain(e.stats) + param.CalcGain(c) - snode[nid].root_gain;
+          const double loss_chg = param.CalcGain(e.stats) +
+              param.CalcGain(c) - snode[nid].root_gain;
           const float delta = is_forward_search ? rt_eps : -rt_eps;
           e.best.Update(loss_chg, fid, e.last_fvalue + delta, !is_forward_search);
         }
       }
+      for (size_t i = 0; i < touched.size(); ++i) {
+        temp[touched[i]].stats.Clear();
+      }
+    }
+    // enumerate the splits of the selected features, each feature is scanned by one thread
+    inline void EnumerateFeatures(const std::vector<unsigned> &feat_set,
+                                  const std::vector<bst_gpair> &gpair, const FMatrix &fmat) {
+      const unsigned nsize = static_cast<unsigned>(feat_set.size());
+      #if defined(_OPENMP)
+      const int batch_size = std::max(static_cast<int>(nsize / this->nthread / 32), 1);
+      #endif
+      #pragma omp parallel for schedule(dynamic, batch_size)
+      for (unsigned i = 0; i < nsize; ++i) {
+        const unsigned fid = feat_set[i];
+        const int tid = omp_get_thread_num();
+        const float density = fmat.GetColDensity(fid);
+        if (param.need_forward_search(density)) {
+          this->EnumerateSplit(this->GetSortedCol(fmat, fid), fid, gpair,
+                               stemp[tid], &stouched[tid], true);
+        }
+        if (param.need_backward_search(density)) {
+          this->EnumerateSplit(this->GetReverseSortedCol(fmat, fid), fid, gpair,
+                               stemp[tid], &stouched[tid], false);
+        }
+      }
     }
     // find splits at current level, do split per level
     inline void FindSplit(int depth, const std::vector<int> &qexpand,
@@ -279,25 +290,11 @@ class ColMaker: public IUpdater<FMatrix> {
         feat_set.resize(n);
       }
       // start enumeration
-      const unsigned nsize = static_cast<unsigned>(feat_set.size());
-      #if defined(_OPENMP)
-      const int batch_size = std::max(static_cast<int>(nsize / this->nthread / 32), 1);
-      #endif
-      #pragma omp parallel for schedule(dynamic, batch_size)
-      for (unsigned i = 0; i < nsize; ++i) {
-        const unsigned fid = feat_set[i];
-        const int tid = omp_get_thread_num();
-        if (param.need_forward_search(fmat.GetColDensity(fid))) {
-          this->EnumerateSplit(fmat.GetSortedCol(fid), fid, gpair, stemp[tid], true);
-        }
-        if (param.need_backward_search(fmat.GetColDensity(fid))) {
-          this->EnumerateSplit(fmat.GetReverseSortedCol(fid), fid, gpair, stemp[tid], false);
-        }
-      }
+      this->EnumerateFeatures(feat_set, gpair, fmat);
       // after this each thread's stemp will get the best candidates, aggregate results
       for (size_t i = 0; i < qexpand.size(); ++i) {
         const int nid = qexpand[i];
-        NodeEntry &e = snode[nid];
+        typename Base::NodeEntry &e = snode[nid];
         for (int tid = 0; tid < this->nthread; ++tid) {
           e.best.Update(stemp[tid][nid].best);
         }
@@ -312,7 +309,7 @@ class ColMaker: public IUpdater<FMatrix> {
     }
     // reset position of each data points after split is created in the tree
     inline void ResetPosition(const std::vector<int> &qexpand, const FMatrix &fmat, const RegTree &tree) {
-      const std::vector<bst_uint> &rowset = fmat.buffered_rowset();
+      const std::vector<bst_uint> &rowset = sampled_rowset;
       // step 1, set default direct nodes to default, and leaf nodes to -1
       const unsigned ndata = static_cast<unsigned>(rowset.size());
       #pragma omp parallel for schedule(static)
@@ -341,7 +338,7 @@ class ColMaker: public IUpdater<FMatrix> {
       #pragma omp parallel for schedule(dynamic, 1)
       for (unsigned i = 0; i < nfeats; ++i) {
         const unsigned fid = fsplits[i];
-        for (typename FMatrix::ColIter it = fmat.GetSortedCol(fid); it.Next();) {
+        for (typename FMatrix::ColIter it = this->GetSortedCol(fmat, fid); it.Next();) {
           const bst_uint ridx = it.rindex();
           int nid = position[ridx];
           if (nid == -1) continue;
@@ -358,19 +355,14 @@ class ColMaker: public IUpdater<FMatrix> {
       }
     }
     //--data fields--
-    const TrainParam &param;
-    // number of omp thread used during training
-    int nthread;
-    // Per feature: shuffle index of each feature index
-    std::vector<unsigned> feat_index;
-    // Instance Data: current node position in the tree of each instance
-    std::vector<int> position;
     // PerThread x PerTreeNode: statistics for per thread construction
     std::vector< std::vector<ThreadEntry> > stemp;
-    /*! \brief TreeNode Data: statistics for each constructed node */
-    std::vector<NodeEntry> snode;
-    /*! \brief queue of nodes to be expanded */
-    std::vector<int> qexpand;
+    // PerThread: nodes visited by the column currently being scanned
+    std::vector< std::vector<int> > stouched;
+    // Per feature: start position of the column in scol_data, empty if not built
+    std::vector<size_t> scol_ptr;
+    // sampled rows of the selected columns, findex of an entry is the row index
+    std::vector<SparseBatch::Entry> scol_data;
   };
 };
 
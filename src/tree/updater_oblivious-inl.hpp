@@ -0,0 +1,310 @@
+#ifndef XGBOOST_TREE_UPDATER_OBLIVIOUS_INL_HPP_
+#define XGBOOST_TREE_UPDATER_OBLIVIOUS_INL_HPP_
+/*!
+ * \file updater_oblivious-inl.hpp
+ * \brief use columnwise update to construct an oblivious tree,
+ *   all the nodes at a depth are split by the same feature and threshold,
+ *   which is chosen by the gain summed over all the nodes of the depth
+ */
+#include <vector>
+#include <algorithm>
+#include "./param.h"
+#include "./updater.h"
+#include "./updater_basemaker-inl.hpp"
+#include "../utils/omp.h"
+#include "../utils/random.h"
+
+namespace xgboost {
+namespace tree {
+/*!
+ * \brief updater that grows oblivious trees level by level, the tree is kept as
+ *  a normal RegTree, and can be evaluated without branch by predictor=oblivious,
+ *  it can not be followed by prune, which breaks the shared splits
+ */
+template<typename FMatrix, typename TStats>
+class ObliviousMaker: public IUpdater<FMatrix> {
+ public:
+  virtual ~ObliviousMaker(void) {}
+  // set training parameter
+  virtual void SetParam(const char *name, const char *val) {
+    param.SetParam(name, val);
+  }
+  virtual void Update(const std::vector<bst_gpair> &gpair,
+                      const FMatrix &fmat,
+                      const BoosterInfo &info,
+                      const std::vector<RegTree*> &trees) {
+    // rescale learning rate according to size of trees
+    float lr = param.learning_rate;
+    param.learning_rate = lr / trees.size();
+    // build tree
+    for (size_t i = 0; i < trees.size(); ++i) {
+      Builder builder(param);
+      builder.Update(gpair, fmat, info, trees[i]);
+    }
+    param.learning_rate = lr;
+  }
+
+ private:
+  // training parameter
+  TrainParam param;
+  // data structure
+  /*! \brief per thread x per node entry to store tmp data */
+  struct ThreadEntry {
+    /*! \brief statistics of data on the scanned side of current column */
+    TStats stats;
+    /*! \brief gain of the node with current threshold, included in the level gain */
+    double gain;
+    /*! \brief whether stats changed after gain is computed */
+    bool dirty;
+    /*! \brief whether current threshold gives a child lighter than min_child_weight */
+    bool invalid;
+    // constructor
+    ThreadEntry(void) : gain(0.0), dirty(false), invalid(false) {
+      stats.Clear();
+    }
+  };
+  // actual builder that runs the algorithm
+  struct Builder : public BaseMaker<FMatrix, TStats> {
+   public:
+    typedef BaseMaker<FMatrix, TStats> Base;
+    using Base::param;
+    using Base::feat_index;
+    using Base::position;
+    using Base::sampled_rowset;
+    using Base::snode;
+    using Base::qexpand;
+    // constructor
+    explicit Builder(const TrainParam &param) : Base(param) {}
+    // update one tree, growing
+    virtual void Update(const std::vector<bst_gpair> &gpair,
+                        const FMatrix &fmat,
+                        const BoosterInfo &info,
+                        RegTree *p_tree) {
+      this->InitData(gpair, fmat, info.root_index, *p_tree);
+      this->InitNewNode(qexpand, gpair, *p_tree);
+      for (int depth = 0; depth < param.max_depth; ++depth) {
+        if (!this->FindSplit(qexpand, gpair, fmat, p_tree)) break;
+        this->ResetPosition(qexpand, fmat, *p_tree);
+        this->UpdateQueueExpand(*p_tree, &this->qexpand);
+        this->InitNewNode(qexpand, gpair, *p_tree);
+      }
+      // set all the rest expanding nodes to leaf
+      for (size_t i = 0; i < qexpand.size(); ++i) {
+        const int nid = qexpand[i];
+        (*p_tree)[nid].set_leaf(snode[nid].weight * param.learning_rate);
+      }
+      // remember auxiliary statistics in the tree node, loss change of each node
+      // is computed from its children, as the split is chosen for the whole level
+      for (int nid = 0; nid < p_tree->param.num_nodes; ++nid) {
+        const RegTree::Node &node = (*p_tree)[nid];
+        p_tree->stat(nid).loss_chg = node.is_leaf() ? 0.0f :
+            snode[node.cleft()].root_gain + snode[node.cright()].root_gain -
+            snode[nid].root_gain;
+        p_tree->stat(nid).base_weight = snode[nid].weight;
+        p_tree->stat(nid).sum_hess = static_cast<float>(snode[nid].stats.sum_hess);
+      }
+    }
+
+   private:
+    // initialize temp data structure
+    inline void InitData(const std::vector<bst_gpair> &gpair,
+                         const FMatrix &fmat,
+                         const std::vector<unsigned> &root_index, const RegTree &tree) {
+      utils::Check(tree.param.num_roots == 1 && root_index.size() == 0,
+                   "ObliviousMaker: only support one root");
+      utils::Check(param.goss_top_rate == 0.0f,
+                   "ObliviousMaker: one-side sampling is not supported");
+      Base::InitData(gpair, fmat, root_index, tree);
+      {// setup temp space for each thread
+        stemp.clear();
+        stemp.resize(this->nthread, std::vector<ThreadEntry>());
+        stouched.resize(this->nthread, std::vector<int>());
+        svisited.resize(this->nthread, std::vector<int>());
+        sbest.resize(this->nthread);
+      }
+    }
+    // initialize the new nodes in qexpand, and setup statistics space of them for each thread
+    inline void InitNewNode(const std::vector<int> &qexpand,
+                            const std::vector<bst_gpair> &gpair,
+                            const RegTree &tree) {
+      for (size_t i = 0; i < stemp.size(); ++i) {
+        stemp[i].resize(tree.param.num_nodes, ThreadEntry());
+      }
+      Base::InitNewNode(qexpand, gpair, tree);
+    }
+    // gain of splitting nid when the scanned side has statistics e.stats,
+    // a side with no data means the split does not change the node,
+    // otherwise *invalid is set if a side is lighter than min_child_weight
+    inline double NodeGain(int nid, const ThreadEntry &e, bool *invalid) const {
+      const TStats c = snode[nid].stats.Substract(e.stats);
+      *invalid = false;
+      if (e.stats.Empty() || c.Empty()) return 0.0;
+      *invalid = e.stats.sum_hess < param.min_child_weight || c.sum_hess < param.min_child_weight;
+      return param.CalcGain(e.stats) + param.CalcGain(c) - snode[nid].root_gain;
+    }
+    // enumerate the split values of specific feature, a candidate threshold is scored by
+    // the gain summed over all the nodes in the level, which is updated incrementally
+    // with the nodes whose statistics changed since last candidate, the threshold is
+    // skipped if it gives a child lighter than min_child_weight in any node
+    template<typename Iter>
+    inline void EnumerateSplit(Iter it, unsigned fid,
+                               const std::vector<bst_gpair> &gpair,
+                               std::vector<ThreadEntry> &temp,
+                               std::vector<int> *p_touched,
+                               std::vector<int> *p_visited,
+                               SplitEntry *p_best,
+                               bool is_forward_search) {
+      std::vector<int> &touched = *p_touched;
+      std::vector<int> &visited = *p_visited;
+      touched.clear(); visited.clear();
+      double level_gain = 0.0;
+      // number of nodes in which current threshold is invalid
+      int ninvalid = 0;
+      float last_fvalue = 0.0f;
+      bool started = false;
+      while (it.Next()) {
+        const bst_uint ridx = it.rindex();
+        const int nid = position[ridx];
+        if (nid < 0) continue;
+        const float fvalue = it.fvalue();
+        if (started && fabsf(fvalue - last_fvalue) > rt_2eps) {
+          level_gain += this->UpdateGain(temp, touched, &ninvalid);
+          if (ninvalid == 0) {
+            p_best->Update(static_cast<bst_float>(level_gain), fid,
+                           (fvalue + last_fvalue) * 0.5f, !is_forward_search);
+          }
+        }
+        ThreadEntry &e = temp[nid];
+        if (e.stats.Empty()) visited.push_back(nid);
+        if (!e.dirty) {
+          e.dirty = true; touched.push_back(nid);
+        }
+        e.stats.Add(gpair[ridx]);
+        last_fvalue = fvalue;
+        started = true;
+      }
+      // all the values present in the column go to one side
+      if (started) {
+        level_gain += this->UpdateGain(temp, touched, &ninvalid);
+        const float delta = is_forward_search ? rt_eps : -rt_eps;
+        if (ninvalid == 0) {
+          p_best->Update(static_cast<bst_float>(level_gain), fid,
+                         last_fvalue + delta, !is_forward_search);
+        }
+      }
+      // clear the statistics of the nodes visited by this column
+      for (size_t i = 0; i < visited.size(); ++i) {
+        temp[visited[i]].stats.Clear();
+        temp[visited[i]].gain = 0.0;
+        temp[visited[i]].invalid = false;
+      }
+    }
+    // recompute gain of the nodes changed since last call, return the change of level gain,
+    // the number of nodes in which the threshold is invalid is updated in *p_ninvalid
+    inline double UpdateGain(std::vector<ThreadEntry> &temp, std::vector<int> &touched,
+                             int *p_ninvalid) {
+      double delta = 0.0;
+      for (size_t i = 0; i < touched.size(); ++i) {
+        ThreadEntry &e = temp[touched[i]];
+        bool invalid;
+        const double gain = this->NodeGain(touched[i], e, &invalid);
+        delta += gain - e.gain;
+        *p_ninvalid += static_cast<int>(invalid) - static_cast<int>(e.invalid);
+        e.gain = gain; e.dirty = false; e.invalid = invalid;
+      }
+      touched.clear();
+      return delta;
+    }
+    // enumerate the splits of all the features
+    inline void EnumerateFeatures(const std::vector<unsigned> &feat_set,
+                                  const std::vector<bst_gpair> &gpair, const FMatrix &fmat) {
+      const unsigned nsize = static_cast<unsigned>(feat_set.size());
+      #if defined(_OPENMP)
+      const int batch_size = std::max(static_cast<int>(nsize / this->nthread / 32), 1);
+      #endif
+      #pragma omp parallel for schedule(dynamic, batch_size)
+      for (unsigned i = 0; i < nsize; ++i) {
+        const int tid = omp_get_thread_num();
+        const unsigned fid = feat_set[i];
+        const float density = fmat.GetColDensity(fid);
+        if (param.need_forward_search(density)) {
+          this->EnumerateSplit(fmat.GetSortedCol(fid), fid, gpair,
+                               stemp[tid], &stouched[tid], &svisited[tid],
+                               &sbest[tid], true);
+        }
+        if (param.need_backward_search(density)) {
+          this->EnumerateSplit(fmat.GetReverseSortedCol(fid), fid, gpair,
+                               stemp[tid], &stouched[tid], &svisited[tid],
+                               &sbest[tid], false);
+        }
+      }
+    }
+    // find the split shared by all the nodes at current level, return whether the level is split
+    inline bool FindSplit(const std::vector<int> &qexpand,
+                          const std::vector<bst_gpair> &gpair, const FMatrix &fmat,
+                          RegTree *p_tree) {
+      std::vector<unsigned> feat_set = feat_index;
+      if (param.colsample_bylevel != 1.0f) {
+        random::Shuffle(feat_set);
+        unsigned n = static_cast<unsigned>(param.colsample_bylevel * feat_index.size());
+        utils::Check(n > 0, "colsample_bylevel is too small that no feature can be included");
+        feat_set.resize(n);
+      }
+      for (size_t tid = 0; tid < sbest.size(); ++tid) {
+        sbest[tid] = SplitEntry();
+      }
+      // start enumeration
+      this->EnumerateFeatures(feat_set, gpair, fmat);
+      SplitEntry best;
+      for (int tid = 0; tid < this->nthread; ++tid) {
+        best.Update(sbest[tid]);
+      }
+      if (best.loss_chg <= rt_eps) return false;
+      for (size_t i = 0; i < qexpand.size(); ++i) {
+        const int nid = qexpand[i];
+        p_tree->AddChilds(nid);
+        (*p_tree)[nid].set_split(best.split_index(), best.split_value, best.default_left());
+      }
+      return true;
+    }
+    // reset position of each data points after the level is split
+    inline void ResetPosition(const std::vector<int> &qexpand, const FMatrix &fmat,
+                              const RegTree &tree) {
+      const std::vector<bst_uint> &rowset = sampled_rowset;
+      // step 1, set all the data to default branch
+      const unsigned ndata = static_cast<unsigned>(rowset.size());
+      #pragma omp parallel for schedule(static)
+      for (unsigned i = 0; i < ndata; ++i) {
+        const bst_uint ridx = rowset[i];
+        const int nid = position[ridx];
+        position[ridx] = tree[nid].default_left() ? tree[nid].cleft(): tree[nid].cright();
+      }
+      // step 2, classify the data present in the split feature, all nodes use the same one
+      const unsigned fid = tree[qexpand[0]].split_index();
+      for (typename FMatrix::ColIter it = fmat.GetSortedCol(fid); it.Next();) {
+        const bst_uint ridx = it.rindex();
+        int nid = position[ridx];
+        if (nid < 0) continue;
+        nid = tree[nid].parent();
+        if (it.fvalue() < tree[nid].split_cond()) {
+          position[ridx] = tree[nid].cleft();
+        } else {
+          position[ridx] = tree[nid].cright();
+        }
+      }
+    }
+    //--data fields--
+    // PerThread x PerTreeNode: statistics for per thread construction
+    std::vector< std::vector<ThreadEntry> > stemp;
+    // PerThread: nodes whose statistics changed since the last candidate
+    std::vector< std::vector<int> > stouched;
+    // PerThread: best split of the level found by the thread
+    std::vector<SplitEntry> sbest;
+    // PerThread: nodes visited by the column currently being scanned
+    std::vector< std::vector<int> > svisited;
+  };
+};
+
+}  // namespace tree
+}  // namespace xgboost
+#endif  // XGBOOST_TREE_UPDATER_OBLIVIOUS_INL_HPP_
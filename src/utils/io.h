@@ -3,7 +3,14 @@
 #include <cstdio>
 #include <vector>
 #include <string>
+#include <cstring>
 #include "./utils.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 /*!
  * \file io.h
  * \brief general stream interface for serialization, I/O
@@ -29,6 +36,19 @@ class IStream {
    * \param size size of block
    */
   virtual void Write(const void *ptr, size_t size) = 0;
+  /*!
+   * \brief get pointer to the next size bytes without copying, and skip them,
+   *   the pointer is valid as long as the stream is alive
+   * \param size size of block
+   * \return pointer to the block, NULL if the stream does not support it
+   */
+  virtual const void *MapRead(size_t size) {
+    return NULL;
+  }
+  /*! \return current position in the stream, used to align data */
+  virtual size_t Tell(void) {
+    return 0;
+  }
   /*! \brief virtual destructor */
   virtual ~IStream(void) {}
 
@@ -102,11 +122,104 @@ class FileStream : public IStream {
   virtual void Write(const void *ptr, size_t size) {
     fwrite(ptr, size, 1, fp);
   }
+  virtual size_t Tell(void) {
+    return static_cast<size_t>(ftell(fp));
+  }
   inline void Close(void) {
     fclose(fp);
   }
 };
 
+/*!
+ * \brief read only stream of a memory mapped file,
+ *   MapRead returns pointers into the mapping, so data can be used in place
+ *   and pages are loaded lazily and shared between processes using the same file,
+ *   files that can not be mapped, such as pipes, are read into memory instead,
+ *   a mapped file must not be rewritten in place while in use, access to the pages
+ *   beyond its new end raises SIGBUS, replace it by renaming a new file over it
+ */
+class MMapStream : public IStream {
+ public:
+  explicit MMapStream(const char *fname) {
+    data_ = NULL; size_ = pos_ = 0; mapped_ = false; is_mmap_ = false;
+#ifndef _WIN32
+    int fd = open(fname, O_RDONLY);
+    Check(fd >= 0, "can not open file \"%s\"", fname);
+    struct stat st;
+    Check(fstat(fd, &st) == 0, "can not stat file \"%s\"", fname);
+    if (S_ISREG(st.st_mode) && st.st_size != 0) {
+      void *ptr = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED) {
+        data_ = static_cast<const char*>(ptr);
+        size_ = static_cast<size_t>(st.st_size);
+        is_mmap_ = true;
+      }
+    }
+    if (!is_mmap_) {
+      char buf[1 << 16];
+      ssize_t n;
+      while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        buffer_.insert(buffer_.end(), buf, buf + n);
+      }
+      Check(n == 0, "can not read file \"%s\"", fname);
+    }
+    close(fd);
+#else
+    FILE *fp = FopenCheck(fname, "rb");
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) != 0) {
+      buffer_.insert(buffer_.end(), buf, buf + n);
+    }
+    fclose(fp);
+#endif
+    if (!is_mmap_) {
+      size_ = buffer_.size();
+      if (size_ != 0) data_ = &buffer_[0];
+    }
+  }
+  virtual ~MMapStream(void) {
+#ifndef _WIN32
+    if (is_mmap_) munmap(const_cast<char*>(data_), size_);
+#endif
+  }
+  virtual size_t Read(void *ptr, size_t size) {
+    if (size > size_ - pos_) return 0;
+    memcpy(ptr, data_ + pos_, size);
+    pos_ += size;
+    return size;
+  }
+  virtual void Write(const void *ptr, size_t size) {
+    Error("MMapStream is read only");
+  }
+  virtual const void *MapRead(size_t size) {
+    Check(size <= size_ - pos_, "MMapStream: unexpected end of file");
+    const char *ret = data_ + pos_;
+    pos_ += size;
+    mapped_ = true;
+    return ret;
+  }
+  virtual size_t Tell(void) {
+    return pos_;
+  }
+  /*! \return whether any data is used in place, the stream must be kept alive if so */
+  inline bool mapped(void) const {
+    return mapped_;
+  }
+
+ private:
+  /*! \brief start of the file content */
+  const char *data_;
+  /*! \brief size of file and current position */
+  size_t size_, pos_;
+  /*! \brief whether MapRead is called */
+  bool mapped_;
+  /*! \brief whether the file is memory mapped */
+  bool is_mmap_;
+  /*! \brief content of the file when it can not be mapped */
+  std::vector<char> buffer_;
+};
+
 }  // namespace utils
 }  // namespace xgboost
 #endif
@@ -40,48 +40,118 @@ typedef long int64_t;
 #include <cstdio>
 #include <cstdarg>
 #include <cstdlib>
+#include <cmath>
+#include <string>
 
 namespace xgboost {
 /*! \brief namespace for helper utils of the project */
 namespace utils {
 
+#ifndef XGBOOST_CUSTOMIZE_ERROR_
+/*! \brief handle fatal error, print the message and exit */
+inline void HandleError(const char *msg) {
+  fprintf(stderr, "%s\n", msg);
+  exit(-1);
+}
+#else
+/*!
+ * \brief handle fatal error, defined by the program when XGBOOST_CUSTOMIZE_ERROR_ is set,
+ *  it must not return
+ */
+void HandleError(const char *msg);
+#endif
+
 /*! \brief assert an condition is true, use this to handle debug information */
 inline void Assert(bool exp, const char *fmt, ...) {
   if (!exp) {
+    char msg[1024];
+    int len = snprintf(msg, sizeof(msg), "AssertError:");
     va_list args;
     va_start(args, fmt);
-    fprintf(stderr, "AssertError:");
-    vfprintf(stderr, fmt, args);
+    vsnprintf(msg + len, sizeof(msg) - len, fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
-    exit(-1);
+    HandleError(msg);
   }
 }
 
 /*!\brief same as assert, but this is intended to be used as message for user*/
 inline void Check(bool exp, const char *fmt, ...) {
   if (!exp) {
+    char msg[1024];
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vsnprintf(msg, sizeof(msg), fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
-    exit(-1);
+    HandleError(msg);
   }
 }
 
 /*! \brief report error message, same as check */
 inline void Error(const char *fmt, ...) {
   {
+    char msg[1024];
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vsnprintf(msg, sizeof(msg), fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
-    exit(-1);
+    HandleError(msg);
   }
 }
 
+/*!
+ * \brief hint the processor to load the memory at address into cache,
+ *  no-op if the compiler does not support it
+ */
+inline void Prefetch(const void *ptr) {
+#if defined(__GNUC__)
+  __builtin_prefetch(ptr);
+#endif
+}
+
+/*! \brief size of buffer of FloatToText, enough for any float printed by %f */
+const int kFloatTextLen = 64;
+
+/*!
+ * \brief format float as C literal that is parsed back to exactly the same value,
+ *  used when generating code from model
+ */
+inline std::string FloatToCode(float value) {
+  if (std::isinf(value)) return value > 0 ? "INFINITY" : "-INFINITY";
+  if (std::isnan(value)) return "NAN";
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.9g", value);
+  std::string ret(buf);
+  if (ret.find_first_of(".e") == std::string::npos) ret += ".0";
+  return ret + "f";
+}
+
+/*!
+ * \brief format float in the same way as printf("%f"), but several times faster,
+ *  the value times 1e6 is exact in double, so rounding it gives the same digits
+ * \param value the value to be formatted
+ * \param buf output buffer, must have space of kFloatTextLen chars
+ * \return length of the text, not including the terminating zero
+ */
+inline int FloatToText(float value, char *buf) {
+  const double r = std::fabs(static_cast<double>(value)) * 1e6;
+  // large values and nan are handled by printf
+  if (!(r < 1e18)) return snprintf(buf, kFloatTextLen, "%f", value);
+  uint64_t q = static_cast<uint64_t>(std::nearbyint(r));
+  char digit[24];
+  int ndigit = 0;
+  do {
+    digit[ndigit++] = static_cast<char>('0' + q % 10);
+    q /= 10;
+  } while (q != 0 || ndigit < 7);
+  int len = 0;
+  if (std::signbit(value)) buf[len++] = '-';
+  for (int i = ndigit - 1; i >= 6; --i) buf[len++] = digit[i];
+  buf[len++] = '.';
+  for (int i = 5; i >= 0; --i) buf[len++] = digit[i];
+  buf[len] = '\0';
+  return len;
+}
+
 /*! \brief replace fopen, report error when the file open fails */
 inline FILE *FopenCheck(const char *fname, const char *flag) {
   FILE *fp = fopen64(fname, flag);
@@ -8,6 +8,8 @@
 #include "utils/utils.h"
 #include "utils/config.h"
 #include "learner/learner-inl.hpp"
+#include "io/stream_pred-inl.hpp"
+#include "io/pred_output.h"
 
 namespace xgboost {
 /*!
@@ -35,6 +37,9 @@ class BoostLearnTask{
     if (task == "dump") {
       this->TaskDump(); return 0;
     }
+    if (task == "compile") {
+      this->TaskCompile(); return 0;
+    }
     if (task == "eval") {
       this->TaskEval(); return 0;
     }
@@ -50,6 +55,9 @@ class BoostLearnTask{
     if (!strcmp("use_buffer", name)) use_buffer = atoi(val);
     if (!strcmp("num_round", name)) num_round = atoi(val);
     if (!strcmp("pred_margin", name)) pred_margin = atoi(val);
+    if (!strcmp("ntree_limit", name)) ntree_limit = atoi(val);
+    if (!strcmp("pred_stream", name)) pred_stream = atoi(val);
+    if (!strcmp("pred_contrib", name)) pred_contrib = atoi(val);
     if (!strcmp("save_period", name)) save_period = atoi(val);
     if (!strcmp("eval_train", name)) eval_train = atoi(val);
     if (!strcmp("task", name)) task = val;
@@ -60,7 +68,9 @@ class BoostLearnTask{
     if (!strcmp("model_dir", name)) model_dir_path = val;
     if (!strcmp("fmap", name)) name_fmap = val;
     if (!strcmp("name_dump", name)) name_dump = val;
+    if (!strcmp("name_code", name)) name_code = val;
     if (!strcmp("name_pred", name)) name_pred = val;
+    if (!strcmp("pred_format", name)) pred_format = val;
     if (!strcmp("dump_stats", name)) dump_model_stats = atoi(val);
     if (!strncmp("eval[", name, 5)) {
       char evname[256];
@@ -69,6 +79,7 @@ class BoostLearnTask{
       eval_data_paths.push_back(std::string(val));
     }
     learner.SetParam(name, val);
+    stream_pred.SetParam(name, val);
   }
  public:
   BoostLearnTask(void) {
@@ -79,13 +90,18 @@ class BoostLearnTask{
     save_period = 0;
     eval_train = 0;
     pred_margin = 0;
+    ntree_limit = 0;
+    pred_stream = 0;
+    pred_contrib = 0;
     dump_model_stats = 0;
     task = "train";
     model_in = "NULL";
     model_out = "NULL";
     name_fmap = "NULL";
     name_pred = "pred.txt";
+    pred_format = "text";
     name_dump = "dump.txt";
+    name_code = "model.c";
     model_dir_path = "./";
     data = NULL;
   }
@@ -97,9 +113,13 @@ class BoostLearnTask{
   }
  private:
   inline void InitData(void) {
+    utils::Check(pred_format == "text" || pred_format == "binary",
+                 "pred_format must be text or binary");
     if (name_fmap != "NULL") fmap.LoadText(name_fmap.c_str());
-    if (task == "dump") return;
+    if (task == "dump" || task == "compile") return;
     if (task == "pred") {
+      // streaming prediction reads test:data by itself
+      if (pred_stream != 0) return;
       data = io::LoadDataMatrix(test_path.c_str(), silent != 0, use_buffer != 0);
     } else {
       // training
@@ -126,9 +146,7 @@ class BoostLearnTask{
   }
   inline void InitLearner(void) {
     if (model_in != "NULL"){
-      utils::FileStream fi(utils::FopenCheck(model_in.c_str(), "rb"));
-      learner.LoadModel(fi);
-      fi.Close();
+      learner.LoadModel(model_in.c_str());
     } else {
       utils::Assert(task == "train", "model_in not specified");
       learner.InitModel();
@@ -173,10 +191,14 @@ class BoostLearnTask{
     }
     fclose(fo);
   }
+  inline void TaskCompile(void) {
+    FILE *fo = utils::FopenCheck(name_code.c_str(), "w");
+    std::string code = learner.GenerateCode(pred_margin != 0);
+    fprintf(fo, "%s", code.c_str());
+    fclose(fo);
+  }
   inline void SaveModel(const char *fname) const {
-    utils::FileStream fo(utils::FopenCheck(fname, "wb"));
-    learner.SaveModel(fo);
-    fo.Close();
+    learner.SaveModel(fname);
   }
   inline void SaveModel(int i) const {
     char fname[256];
@@ -184,15 +206,25 @@ class BoostLearnTask{
     this->SaveModel(fname);
   }
   inline void TaskPred(void) {
+    if (pred_stream != 0) {
+      utils::Check(pred_contrib == 0, "pred_contrib is not supported with pred_stream");
+      if (!silent) printf("start streaming prediction, writing to %s\n", name_pred.c_str());
+      stream_pred.Run(learner, test_path.c_str(), name_pred.c_str());
+      return;
+    }
     std::vector<float> preds;
     if (!silent) printf("start prediction...\n");
-    learner.Predict(*data, pred_margin != 0, &preds);
-    if (!silent) printf("writing prediction to %s\n", name_pred.c_str());
-    FILE *fo = utils::FopenCheck(name_pred.c_str(), "w");
-    for (size_t i = 0; i < preds.size(); i++) {
-      fprintf(fo, "%f\n", preds[i]);
+    if (pred_contrib != 0) {
+      utils::Check(ntree_limit == 0, "ntree_limit is not supported with pred_contrib");
+      learner.PredictContrib(*data, &preds);
+    } else if (ntree_limit != 0) {
+      learner.PredictStaged(*data, pred_margin != 0,
+                            std::vector<unsigned>(1, static_cast<unsigned>(ntree_limit)), &preds);
+    } else {
+      learner.Predict(*data, pred_margin != 0, &preds);
     }
-    fclose(fo);
+    if (!silent) printf("writing prediction to %s\n", name_pred.c_str());
+    io::WritePred(name_pred.c_str(), preds, pred_format == "binary");
   }
  private:
   /*! \brief whether silent */
@@ -217,14 +249,27 @@ class BoostLearnTask{
   std::string task;
   /*! \brief name of predict file */
   std::string name_pred;
+  /*! \brief format of predict file, text or binary, which is raw little endian float32 */
+  std::string pred_format;
   /*!\brief whether to directly output margin value */
   int pred_margin;
+  /*! \brief number of boosting rounds used in prediction, 0 means all the rounds */
+  int ntree_limit;
+  /*! \brief whether to predict test:data as a stream, in memory bounded by pred_stream_mb */
+  int pred_stream;
+  /*!
+   * \brief whether to output feature contributions instead of prediction, each row
+   *  takes num_feature + 1 values per output group, the last of which is the bias term
+   */
+  int pred_contrib;
   /*! \brief whether dump statistics along with model */
   int dump_model_stats;
   /*! \brief name of feature map */
   std::string name_fmap;
   /*! \brief name of dump file */
   std::string name_dump;
+  /*! \brief name of generated C source file of task compile */
+  std::string name_code;
   /*! \brief the paths of validation data sets */
   std::vector<std::string> eval_data_paths;
   /*! \brief the names of the evaluation data used in output log */
@@ -235,6 +280,7 @@ class BoostLearnTask{
   std::vector<const io::DataMatrix*> devalall;
   utils::FeatMap fmap;
   learner::BoostLearner<FMatrixS> learner;
+  io::StreamPredictor stream_pred;
 };
 }
 
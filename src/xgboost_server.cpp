@@ -0,0 +1,92 @@
+#define _CRT_SECURE_NO_WARNINGS
+#define _CRT_SECURE_NO_DEPRECATE
+// errors in loading a reloaded model are recovered by the server,
+// the flag is set for all files of the server, including io.cpp
+#ifndef XGBOOST_CUSTOMIZE_ERROR_
+#error "xgboost_server must be built with -DXGBOOST_CUSTOMIZE_ERROR_"
+#endif
+
+#include <string>
+#include <cstring>
+#include "io/io.h"
+#include "utils/utils.h"
+#include "utils/config.h"
+#include "server/pred_server-inl.hpp"
+#include "server/load_client-inl.hpp"
+
+namespace xgboost {
+namespace utils {
+void HandleError(const char *msg) {
+  server::PredServer::HandleError(msg);
+}
+}  // namespace utils
+/*!
+ * \brief entry of prediction server and its client
+ *   task=serve: load model_in and serve predictions at socket
+ *   task=bench: replay rows of test:data to the server and report latency
+ *   task=reload: ask the server to switch to model_in
+ *   task=stats: print statistics of the server
+ */
+class ServerTask {
+ public:
+  ServerTask(void) {
+    task = "serve";
+    model_in = "NULL";
+    test_path = "NULL";
+  }
+  inline int Run(int argc, char *argv[]) {
+    if (argc < 2) {
+      printf("Usage: <config> [task=serve|bench|reload|stats]\n");
+      return 0;
+    }
+    utils::ConfigIterator itr(argv[1]);
+    while (itr.Next()) {
+      this->SetParam(itr.name(), itr.val());
+    }
+    for (int i = 2; i < argc; ++i) {
+      char name[256], val[256];
+      if (sscanf(argv[i], "%[^=]=%s", name, val) == 2) {
+        this->SetParam(name, val);
+      }
+    }
+    if (task == "serve") {
+      utils::Check(model_in != "NULL", "model_in not specified");
+      server.Run(model_in.c_str());
+    } else if (task == "bench") {
+      utils::Check(test_path != "NULL", "test:data not specified");
+      client.Bench(test_path.c_str());
+    } else if (task == "reload") {
+      utils::Check(model_in != "NULL", "model_in not specified");
+      client.Reload(model_in.c_str());
+    } else if (task == "stats") {
+      client.Stats();
+    } else {
+      utils::Error("unknown task %s", task.c_str());
+    }
+    return 0;
+  }
+  inline void SetParam(const char *name, const char *val) {
+    if (!strcmp("task", name)) task = val;
+    if (!strcmp("model_in", name)) model_in = val;
+    if (!strcmp("test:data", name)) test_path = val;
+    server.SetParam(name, val);
+    client.SetParam(name, val);
+  }
+
+ private:
+  /*! \brief task to perform */
+  std::string task;
+  /*! \brief the path of model file */
+  std::string model_in;
+  /*! \brief the path of data replayed by bench */
+  std::string test_path;
+  server::PredServer server;
+  server::LoadClient client;
+};
+}  // namespace xgboost
+
+int main(int argc, char *argv[]) {
+  xgboost::random::Seed(0);
+  xgboost::ServerTask tsk;
+  return tsk.Run(argc, argv);
+}
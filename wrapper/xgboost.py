@@ -23,6 +23,10 @@ xglib.XGDMatrixNumRow.restype = ctypes.c_ulong
 
 xglib.XGBoosterCreate.restype = ctypes.c_void_p
 xglib.XGBoosterPredict.restype = ctypes.POINTER(ctypes.c_float)
+xglib.XGBoosterPredictStaged.restype = ctypes.POINTER(ctypes.c_float)
+xglib.XGBoosterPredictMulti.restype = ctypes.POINTER(ctypes.c_float)
+xglib.XGBoosterPredictContrib.restype = ctypes.POINTER(ctypes.c_float)
+xglib.XGBoosterPredictContribSparse.restype = ctypes.c_ulong
 xglib.XGBoosterEvalOneIter.restype = ctypes.c_char_p
 xglib.XGBoosterDumpModel.restype = ctypes.POINTER(ctypes.c_char_p)
 
@@ -190,6 +194,43 @@ class Booster:
         preds = xglib.XGBoosterPredict(self.handle, data.handle,
                                        int(output_margin), ctypes.byref(length))
         return ctypes2numpy(preds, length.value)
+    def predict_staged(self, data, stages, output_margin=False):
+        """
+        predict with data after each number of boosting rounds in stages, in one pass
+            data: the dmatrix storing the input
+            stages: numbers of boosting rounds in increasing order, 0 means all the rounds
+            output_margin: whether output raw margin value that is untransformed
+        return array of shape (num_row, len(stages), -1)
+        """
+        length = ctypes.c_ulong()
+        preds = xglib.XGBoosterPredictStaged(self.handle, data.handle, int(output_margin),
+                                             (ctypes.c_uint*len(stages))(*stages),
+                                             len(stages), ctypes.byref(length))
+        return ctypes2numpy(preds, length.value).reshape(data.num_row(), len(stages), -1)
+    def predict_contrib(self, data, sparse=False):
+        """
+        feature contributions of the prediction, the margin of each row and output group is
+        split into the contribution of each feature and a bias term, which is the last column
+            data: the dmatrix storing the input
+            sparse: whether return scipy csr_matrix that only keeps features on decision paths
+        return array of shape (num_row * num_group, num_feature + 1), or csr_matrix
+        of the same shape if sparse is True, rows of the same input row are adjacent
+        """
+        if not sparse:
+            length = ctypes.c_ulong()
+            ncol = ctypes.c_ulong()
+            preds = xglib.XGBoosterPredictContrib(self.handle, data.handle,
+                                                  ctypes.byref(ncol), ctypes.byref(length))
+            return ctypes2numpy(preds, length.value).reshape(-1, ncol.value)
+        ptr = ctypes.POINTER(ctypes.c_ulong)()
+        index = ctypes.POINTER(ctypes.c_uint)()
+        value = ctypes.POINTER(ctypes.c_float)()
+        nptr = xglib.XGBoosterPredictContribSparse(self.handle, data.handle, ctypes.byref(ptr),
+                                                   ctypes.byref(index), ctypes.byref(value))
+        indptr = numpy.array(ptr[:nptr], dtype='int64')
+        nnz = int(indptr[-1])
+        indices = numpy.array(index[:nnz], dtype='int32')
+        return scp.csr_matrix((ctypes2numpy(value, nnz), indices, indptr))
     def save_model(self, fname):
         """ save model to file """
         xglib.XGBoosterSaveModel(self.handle, ctypes.c_char_p(fname.encode('utf-8')))
@@ -235,6 +276,21 @@ class Booster:
                     fmap[fid]+= 1
         return fmap
 
+def predict_multi(boosters, data, output_margin=False):
+    """
+    predict with data by several boosters in one pass, each row is converted once
+        boosters: list of Booster, each must give the same number of predictions per row
+        data: the dmatrix storing the input
+        output_margin: whether output raw margin value that is untransformed
+    return array of shape (num_row, len(boosters), -1)
+    """
+    assert len(boosters) != 0
+    handles = (ctypes.c_void_p * len(boosters))(*[ b.handle.value for b in boosters])
+    length = ctypes.c_ulong()
+    preds = xglib.XGBoosterPredictMulti(handles, len(boosters), data.handle,
+                                        int(output_margin), ctypes.byref(length))
+    return ctypes2numpy(preds, length.value).reshape(data.num_row(), len(boosters), -1)
+
 def evaluate(bst, evals, it, feval = None):
     """evaluation on eval set"""
     if feval != None:
@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <cstring>
+#include <cmath>
 #include <algorithm>
 #include "./xgboost_wrapper.h"
 #include "../src/data.h"
@@ -29,6 +30,84 @@ class Booster: public learner::BoostLearner<FMatrixS> {
     *len = this->preds_.size();
     return &this->preds_[0];
   }
+  const float *PredStaged(const DataMatrix &dmat, int output_margin,
+                          const unsigned *stages, size_t nstage, size_t *len) {
+    this->CheckInitModel();
+    this->PredictStaged(dmat, output_margin != 0,
+                        std::vector<unsigned>(stages, stages + nstage), &this->preds_);
+    *len = this->preds_.size();
+    return &this->preds_[0];
+  }
+  // predict by this booster and others, the result is kept in this booster
+  const float *PredMulti(Booster *others[], size_t nother, const DataMatrix &dmat,
+                         int output_margin, size_t *len) {
+    std::vector<const learner::BoostLearner<FMatrixS>*> learners(1, this);
+    this->CheckInitModel();
+    for (size_t i = 0; i < nother; ++i) {
+      others[i]->CheckInitModel();
+      learners.push_back(others[i]);
+    }
+    PredictMulti(learners, dmat, output_margin != 0, &this->preds_);
+    *len = this->preds_.size();
+    return &this->preds_[0];
+  }
+  inline size_t PredNoBuffer(const DataMatrix &dmat, int output_margin,
+                             float *out, size_t len) const {
+    // the model cannot be lazily initialized here, the booster is shared by the callers
+    utils::Check(init_model, "XGBoosterPredictNoBuffer: model is not loaded");
+    std::vector<float> preds;
+    this->PredictNoBuffer(dmat, output_margin != 0, &preds);
+    utils::Check(preds.size() <= len, "XGBoosterPredictNoBuffer: output array is too small");
+    std::copy(preds.begin(), preds.end(), out);
+    return preds.size();
+  }
+  inline size_t PredRow(const unsigned *indices, const float *values, size_t nnz,
+                        int output_margin, float *out) {
+    this->CheckInitModel();
+    std::vector<SparseBatch::Entry> &row = ThreadLocalRow();
+    row.resize(nnz);
+    for (size_t i = 0; i < nnz; ++i) {
+      row[i] = SparseBatch::Entry(indices[i], values[i]);
+    }
+    return this->PredictRow(SparseBatch::Inst(BeginPtr(row), static_cast<bst_uint>(nnz)),
+                            output_margin != 0, out);
+  }
+  inline size_t PredRowDense(const float *data, size_t ncol, float missing,
+                             int output_margin, float *out) {
+    this->CheckInitModel();
+    std::vector<SparseBatch::Entry> &row = ThreadLocalRow();
+    const bool nan_missing = std::isnan(missing);
+    row.clear();
+    for (size_t j = 0; j < ncol; ++j) {
+      if (data[j] == missing || (nan_missing && std::isnan(data[j]))) continue;
+      row.push_back(SparseBatch::Entry(static_cast<bst_uint>(j), data[j]));
+    }
+    return this->PredictRow(SparseBatch::Inst(BeginPtr(row), static_cast<bst_uint>(row.size())),
+                            output_margin != 0, out);
+  }
+  const float *PredContrib(const DataMatrix &dmat, size_t *ncol, size_t *len) {
+    this->CheckInitModel();
+    this->PredictContrib(dmat, &this->preds_);
+    *ncol = static_cast<size_t>(mparam.num_feature) + 1;
+    *len = this->preds_.size();
+    return &this->preds_[0];
+  }
+  inline size_t PredContribSparse(const DataMatrix &dmat, const size_t **out_ptr,
+                                  const unsigned **out_index, const float **out_value) {
+    this->CheckInitModel();
+    std::vector<SparseBatch::Entry> contrib;
+    this->PredictContrib(dmat, &contrib_ptr, &contrib);
+    contrib_index.resize(contrib.size());
+    this->preds_.resize(contrib.size());
+    for (size_t i = 0; i < contrib.size(); ++i) {
+      contrib_index[i] = contrib[i].findex;
+      this->preds_[i] = contrib[i].fvalue;
+    }
+    *out_ptr = &contrib_ptr[0];
+    *out_index = contrib_index.size() == 0 ? NULL : &contrib_index[0];
+    *out_value = this->preds_.size() == 0 ? NULL : &this->preds_[0];
+    return contrib_ptr.size();
+  }
   inline void BoostOneIter(const DataMatrix &train,
                            float *grad, float *hess, size_t len) {
     this->gpair_.resize(len);
@@ -57,12 +136,23 @@ class Booster: public learner::BoostLearner<FMatrixS> {
     *len = model_dump.size();
     return &model_dump_cptr[0];
   }
+  // temporal row of current thread, used by single row prediction
+  inline static std::vector<SparseBatch::Entry> &ThreadLocalRow(void) {
+    static thread_local std::vector<SparseBatch::Entry> row;
+    return row;
+  }
+  inline static const SparseBatch::Entry *BeginPtr(const std::vector<SparseBatch::Entry> &vec) {
+    return vec.size() == 0 ? NULL : &vec[0];
+  }
   // temporal fields
   // temporal data to save evaluation dump
   std::string eval_str;
   // temporal space to save model dump
   std::vector<std::string> model_dump;
   std::vector<const char*> model_dump_cptr;
+  // temporal space to save sparse feature contributions, values are kept in preds_
+  std::vector<size_t> contrib_ptr;
+  std::vector<unsigned> contrib_index;
 
  private:
   bool init_model;
@@ -233,6 +323,40 @@ extern "C"{
   const float *XGBoosterPredict(void *handle, void *dmat, int output_margin, size_t *len) {
     return static_cast<Booster*>(handle)->Pred(*static_cast<DataMatrix*>(dmat), output_margin, len);
   }
+  const float *XGBoosterPredictStaged(void *handle, void *dmat, int output_margin,
+                                      const unsigned *stages, size_t nstage, size_t *len) {
+    return static_cast<Booster*>(handle)->PredStaged(*static_cast<DataMatrix*>(dmat),
+                                                     output_margin, stages, nstage, len);
+  }
+  const float *XGBoosterPredictMulti(void *handles[], size_t nbooster, void *dmat,
+                                     int output_margin, size_t *len) {
+    utils::Check(nbooster != 0, "XGBoosterPredictMulti: no booster is given");
+    return static_cast<Booster*>(handles[0])->PredMulti(
+        reinterpret_cast<Booster**>(handles + 1), nbooster - 1,
+        *static_cast<DataMatrix*>(dmat), output_margin, len);
+  }
+  const float *XGBoosterPredictContrib(void *handle, void *dmat, size_t *ncol, size_t *len) {
+    return static_cast<Booster*>(handle)->PredContrib(*static_cast<DataMatrix*>(dmat),
+                                                      ncol, len);
+  }
+  size_t XGBoosterPredictContribSparse(void *handle, void *dmat, const size_t **out_ptr,
+                                       const unsigned **out_index, const float **out_value) {
+    return static_cast<Booster*>(handle)->PredContribSparse(*static_cast<DataMatrix*>(dmat),
+                                                            out_ptr, out_index, out_value);
+  }
+  size_t XGBoosterPredictNoBuffer(const void *handle, void *dmat, int output_margin,
+                                  float *out, size_t len) {
+    return static_cast<const Booster*>(handle)->PredNoBuffer(*static_cast<DataMatrix*>(dmat),
+                                                             output_margin, out, len);
+  }
+  size_t XGBoosterPredictRow(void *handle, const unsigned *indices, const float *values,
+                             size_t nnz, int output_margin, float *out) {
+    return static_cast<Booster*>(handle)->PredRow(indices, values, nnz, output_margin, out);
+  }
+  size_t XGBoosterPredictRowDense(void *handle, const float *data, size_t ncol,
+                                  float missing, int output_margin, float *out) {
+    return static_cast<Booster*>(handle)->PredRowDense(data, ncol, missing, output_margin, out);
+  }
   void XGBoosterLoadModel(void *handle, const char *fname) {
     static_cast<Booster*>(handle)->LoadModel(fname);
   }
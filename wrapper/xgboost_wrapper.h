@@ -90,8 +90,10 @@ extern "C" {
   size_t XGDMatrixNumRow(const void *handle);
   // --- start XGBoost class
   /*! 
-   * \brief create xgboost learner 
-   * \param dmats matrices that are set to be cached
+   * \brief create xgboost learner, prediction of the matrices in dmats, and of other matrices
+   *  given to XGBoosterEvalOneIter or XGBoosterPredict later, is cached by the learner,
+   *  the least recently used ones are dropped when the cache exceeds pred_cache_mb
+   * \param dmats matrices used in training, the number of features is set to cover them
    * \param len length of dmats
    */
   void *XGBoosterCreate(void* dmats[], size_t len);
@@ -144,6 +146,94 @@ extern "C" {
    * \param len used to store length of returning result
    */
   const float *XGBoosterPredict(void *handle, void *dmat, int output_margin, size_t *len);
+  /*!
+   * \brief staged prediction based on dmat, the predictions after each number of
+   *        boosting rounds in stages are computed in one pass over the model,
+   *        the prediction buffer is not used
+   * \param handle handle
+   * \param dmat data matrix
+   * \param output_margin whether only output raw margin value
+   * \param stages numbers of boosting rounds in increasing order, 0 means all the rounds
+   * \param nstage number of stages
+   * \param len used to store length of returning result, the predictions of a row
+   *        are stored together, ordered by stage
+   */
+  const float *XGBoosterPredictStaged(void *handle, void *dmat, int output_margin,
+                                      const unsigned *stages, size_t nstage, size_t *len);
+  /*!
+   * \brief make prediction based on dmat by several boosters in one pass, each row is
+   *        converted once and scored by all the boosters, the prediction buffer is not used
+   * \param handles boosters, each must give the same number of predictions per row
+   * \param nbooster number of boosters
+   * \param dmat data matrix
+   * \param output_margin whether only output raw margin value
+   * \param len used to store length of returning result, the predictions of a row
+   *        are stored together, ordered by booster, the result is kept by handles[0]
+   */
+  const float *XGBoosterPredictMulti(void *handles[], size_t nbooster, void *dmat,
+                                     int output_margin, size_t *len);
+  /*!
+   * \brief feature contributions of the prediction based on dmat, the margin of each row
+   *        and output group is split into the contribution of each feature and a bias term
+   * \param handle handle
+   * \param dmat data matrix
+   * \param ncol used to store number of values of each row and output group, which is
+   *        num_feature + 1, the last value is the bias term
+   * \param len used to store length of returning result
+   */
+  const float *XGBoosterPredictContrib(void *handle, void *dmat, size_t *ncol, size_t *len);
+  /*!
+   * \brief sparse version of XGBoosterPredictContrib, in CSR format with one row
+   *        for each row and output group, only the features on the decision paths are output,
+   *        the bias term is the last entry of each row, with index num_feature
+   * \param handle handle
+   * \param dmat data matrix
+   * \param out_ptr used to store row pointer of the result
+   * \param out_index used to store feature index of the result
+   * \param out_value used to store contribution of the result
+   * \return length of out_ptr
+   */
+  size_t XGBoosterPredictContribSparse(void *handle, void *dmat, const size_t **out_ptr,
+                                       const unsigned **out_index, const float **out_value);
+  /*!
+   * \brief thread-safe prediction based on dmat, the prediction buffer is not used and
+   *        the booster is not modified, so many threads can share one loaded booster,
+   *        as long as each thread predicts on its own dmat, the model must be loaded
+   *        by XGBoosterLoadModel or trained before the concurrent calls start
+   * \param handle handle
+   * \param dmat data matrix
+   * \param output_margin whether only output raw margin value
+   * \param out caller owned output array
+   * \param len capacity of out, must be no less than number of rows times num_class
+   * \return number of values written to out
+   */
+  size_t XGBoosterPredictNoBuffer(const void *handle, void *dmat, int output_margin,
+                                  float *out, size_t len);
+  /*!
+   * \brief make prediction of a single row given in sparse format, without creating dmatrix,
+   *        the prediction buffer is not used, and no parallel region is started
+   * \param handle handle
+   * \param indices feature index of the nonzero entries
+   * \param values feature value of the nonzero entries
+   * \param nnz number of nonzero entries
+   * \param output_margin whether only output raw margin value
+   * \param out output array, must have space for num_class values (1 if not multiclass)
+   * \return number of values written to out
+   */
+  size_t XGBoosterPredictRow(void *handle, const unsigned *indices, const float *values,
+                             size_t nnz, int output_margin, float *out);
+  /*!
+   * \brief make prediction of a single dense row, same as XGBoosterPredictRow
+   * \param handle handle
+   * \param data feature values of the row
+   * \param ncol number of columns
+   * \param missing which value to represent missing value
+   * \param output_margin whether only output raw margin value
+   * \param out output array, must have space for num_class values (1 if not multiclass)
+   * \return number of values written to out
+   */
+  size_t XGBoosterPredictRowDense(void *handle, const float *data, size_t ncol,
+                                  float missing, int output_margin, float *out);
   /*!
    * \brief load model from existing file
    * \param handle handle
@@ -151,7 +241,11 @@ extern "C" {
    */
   void XGBoosterLoadModel(void *handle, const char *fname);
   /*!
-   * \brief save model into existing file
+   * \brief save model into existing file,
+   *   set parameter save_mode=inference to save a compact model for prediction only,
+   *   without prediction buffer and node statistics,
+   *   or save_mode=flat to save the flattened trees, which are used in place from
+   *   the memory mapped file after loading, such a model only supports prediction
    * \param handle handle
    * \param fname file name
    */